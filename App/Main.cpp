@@ -5,6 +5,7 @@
 #include "Shlobj.h"
 
 #include "Trainer.h"
+#include "CommandQueue.h"
 
 #include <unordered_set>
 #include <map>
@@ -45,56 +46,114 @@
 #define FORCE_SLOT_2                0x422
 #define FORCE_SLOT_3                0x423
 
+#define POLL_RNG_COUNTERS           0x430
+#define RECORD_RNG_DRAWS            0x431
+
 #define HEARTBEAT                   0x500
+#define RENDER_VIEW_MODEL           0x501
 
 // Globals
 HWND g_hwnd;
 HINSTANCE g_hInstance;
 std::shared_ptr<Trainer> g_trainer;
 std::shared_ptr<Memory> g_bluePrinceProc;
+std::unique_ptr<CommandQueue> g_commands;
 
 HWND g_seedInputs[Trainer::RngClass::NumEntries + 1] = {};
 HWND g_behaviorInputs[Trainer::RngClass::NumEntries + 1] = {};
+HWND g_rngDraws[Trainer::RngClass::NumEntries + 1] = {};
 HWND g_deckLists[3] = {};
 HWND g_forcedSlots[3] = {};
+HWND g_draftStats = NULL;
+
+// Everything which the background threads show in the UI. Workers never touch the controls: they publish a new (immutable) snapshot instead,
+// and the UI thread renders the latest one on a timer, only updating the controls whose text changed since the last render.
+struct ViewModel {
+    std::wstring title;
+    std::array<std::wstring, Trainer::RngClass::NumEntries + 1> seeds;
+    std::array<std::wstring, Trainer::RngClass::NumEntries + 1> behaviors;
+    std::array<std::wstring, Trainer::RngClass::NumEntries + 1> rngDraws;
+    bool recordingRng = false;
+    std::array<std::wstring, 3> deckLists;
+    std::wstring draftStats;
+};
+std::shared_ptr<const ViewModel> g_viewModel; // Only accessed with std::atomic_load / std::atomic_store
+std::shared_ptr<const ViewModel> g_renderedViewModel; // UI thread only
+constexpr UINT s_renderInterval = 50; // ms. Snapshots published more often than this are only rendered once.
+
+// Copies the latest snapshot, applies the update, and swaps it in. If another thread published in the meantime, the update is applied again to theirs.
+template <class Update>
+void PublishViewModel(const Update& update) {
+    std::shared_ptr<const ViewModel> current = std::atomic_load(&g_viewModel);
+    std::shared_ptr<const ViewModel> next;
+    do {
+        auto model = std::make_shared<ViewModel>(*current);
+        update(*model);
+        next = std::move(model);
+    } while (!std::atomic_compare_exchange_weak(&g_viewModel, &current, next));
+}
 
 #define SetWindowTextA(...) static_assert(false, "Call SetStringText instead of SetWindowTextA");
 #define SetWindowTextW(...) static_assert(false, "Call SetStringText instead of SetWindowTextW");
 #undef SetWindowText
 #define SetWindowText(...) static_assert(false, "Call SetStringText instead of SetWindowText");
 
-void SetStringText(HWND hwnd, const std::string& text) {
-    static std::unordered_map<HWND, std::string> hwndText;
-    auto search = hwndText.find(hwnd);
-    if (search != hwndText.end()) {
-        if (search->second == text) return;
-        search->second = text;
-    } else {
-        hwndText[hwnd] = text;
-    }
-
-#pragma push_macro("SetWindowTextA")
-#undef SetWindowTextA
-    SetWindowTextA(hwnd, text.c_str());
-#pragma pop_macro("SetWindowTextA")
-}
-
+// UI thread only. Background threads publish a ViewModel instead.
 void SetStringText(HWND hwnd, const std::wstring& text) {
-    static std::unordered_map<HWND, std::wstring> hwndText;
-    auto search = hwndText.find(hwnd);
-    if (search != hwndText.end()) {
-        if (search->second == text) return;
-        search->second = text;
-    } else {
-        hwndText[hwnd] = text;
-    }
-
 #pragma push_macro("SetWindowTextW")
 #undef SetWindowTextW
     SetWindowTextW(hwnd, text.c_str());
 #pragma pop_macro("SetWindowTextW")
 }
 
+void RenderViewModel() {
+    std::shared_ptr<const ViewModel> model = std::atomic_load(&g_viewModel);
+    if (model == g_renderedViewModel) return;
+    const ViewModel& rendered = *g_renderedViewModel;
+
+    if (model->title != rendered.title) SetStringText(g_hwnd, model->title);
+    for (size_t i = 0; i < model->seeds.size(); i++) {
+        if (model->seeds[i] != rendered.seeds[i]) SetStringText(g_seedInputs[i], model->seeds[i]);
+        if (model->behaviors[i] != rendered.behaviors[i]) SetStringText(g_behaviorInputs[i], model->behaviors[i]);
+        if (model->rngDraws[i] != rendered.rngDraws[i]) SetStringText(g_rngDraws[i], model->rngDraws[i]);
+    }
+    for (size_t slot = 0; slot < model->deckLists.size(); slot++) {
+        if (model->deckLists[slot] != rendered.deckLists[slot]) SetStringText(g_deckLists[slot], model->deckLists[slot]);
+    }
+    if (model->draftStats != rendered.draftStats) SetStringText(g_draftStats, model->draftStats);
+    if (model->recordingRng != rendered.recordingRng) CheckDlgButton(g_hwnd, RECORD_RNG_DRAWS, model->recordingRng ? BST_CHECKED : BST_UNCHECKED);
+    g_renderedViewModel = model;
+}
+
+// The most drawn rooms of this session, with the share of all draws which they got.
+std::wstring FormatDraftStats(const DraftStats& stats) {
+    constexpr size_t s_numRooms = 15;
+    const DraftStats::Counts& counts = stats.GetCounts();
+    uint32_t numDecks = 0;
+    for (uint32_t decks : counts.decks) numDecks += decks;
+    if (numDecks == 0) return L"";
+
+    std::vector<std::pair<uint32_t, uint16_t>> draws; // [draw count, room ID]
+    for (size_t roomId = 1; roomId < stats.NumRoomIds() && roomId < DraftStats::s_maxRooms; roomId++) {
+        uint32_t count = 0;
+        for (const auto& drawn : counts.drawn) count += drawn[roomId];
+        if (count > 0) draws.emplace_back(count, static_cast<uint16_t>(roomId));
+    }
+    size_t numShown = std::min(draws.size(), s_numRooms);
+    std::partial_sort(draws.begin(), draws.begin() + numShown, draws.end(), std::greater<>());
+
+    std::wstring text = L"Drafts this session: " + std::to_wstring(numDecks) + L"\n";
+    for (size_t i = 0; i < numShown; i++) {
+        uint16_t roomId = draws[i].second;
+        text += std::to_wstring(std::llround(stats.DrawRate(roomId) * 100.0)) + L"% ";
+        text += stats.RoomName(roomId);
+        uint32_t streak = stats.CurrentStreak(roomId);
+        if (streak > 1) text += L" (" + std::to_wstring(streak) + L" in a row)";
+        text += L'\n';
+    }
+    return text;
+}
+
 std::wstring GetWindowString(HWND hwnd) {
     SetLastError(0); // GetWindowTextLength does not clear LastError.
     int length = GetWindowTextLengthW(hwnd);
@@ -104,6 +163,130 @@ std::wstring GetWindowString(HWND hwnd) {
     return text;
 }
 
+// The UI state a command acts on. This is read when the command is posted, since only the UI thread may message the UI's windows.
+struct CommandInput {
+    std::wstring text; // The seed or behavior of a "Set" button
+    int selectedIndex = -1; // The option picked in a forced slot's dropdown
+};
+
+// Runs on the UI thread.
+CommandInput ReadCommandInput(WPARAM wParam, LPARAM lParam) {
+    CommandInput input;
+    WORD command = LOWORD(wParam);
+    if (command >= SET_SEED_UNKNOWN && command <= SET_SEED_ALL) {
+        input.text = GetWindowString(g_seedInputs[command - SET_SEED_UNKNOWN]);
+    } else if (command >= SET_BEHAVIOR_UNKNOWN && command <= SET_BEHAVIOR_ALL) {
+        input.text = GetWindowString(g_behaviorInputs[command - SET_BEHAVIOR_UNKNOWN]);
+    } else if (command >= FORCE_SLOT_1 && command <= FORCE_SLOT_3 && HIWORD(wParam) == CBN_SELCHANGE) {
+        input.selectedIndex = (int)SendMessage((HWND)lParam, (UINT)CB_GETCURSEL, NULL, NULL);
+    }
+    return input;
+}
+
+// Runs on one of the command workers.
+void ExecuteCommand(const std::shared_ptr<Trainer>& trainer, WPARAM wParam, const CommandInput& input) {
+    WORD command = LOWORD(wParam);
+    if (command >= SET_SEED_UNKNOWN && command < SET_SEED_UNKNOWN + Trainer::RngClass::NumEntries) {
+        Trainer::RngClass rngClass = (Trainer::RngClass)(command - SET_SEED_UNKNOWN);
+        __int64 seed = std::stoull(input.text);
+        trainer->SetSeed(rngClass, seed);
+    } else if (command == SET_SEED_ALL) {
+        __int64 seed = std::stoull(input.text);
+        trainer->SetAllSeeds(seed);
+        PublishViewModel([seed](ViewModel& model) { model.seeds.fill(std::to_wstring(seed)); });
+    } else if (command >= SET_BEHAVIOR_UNKNOWN && command < SET_BEHAVIOR_UNKNOWN + Trainer::RngClass::NumEntries) {
+        Trainer::RngClass rngClass = (Trainer::RngClass)(command - SET_BEHAVIOR_UNKNOWN);
+        const std::wstring& behavior = input.text;
+        if (behavior == L"Constant") trainer->SetRngBehavior(rngClass, Trainer::RngBehavior::Constant);
+        else if (behavior == L"Increment") trainer->SetRngBehavior(rngClass, Trainer::RngBehavior::Increment);
+        else if (behavior == L"Randomize") trainer->SetRngBehavior(rngClass, Trainer::RngBehavior::Randomize);
+        else {
+            MessageBoxW(g_hwnd, L"Valid RNG behaviors are:\nConstant, Increment, Randomize", L"Invalid RNG behavior", MB_TASKMODAL | MB_ICONHAND | MB_OK | MB_SETFOREGROUND);
+            return;
+        }
+    } else if (command == SET_BEHAVIOR_ALL) {
+        const std::wstring& behavior = input.text;
+        if (behavior == L"Constant") trainer->SetAllBehaviors(Trainer::RngBehavior::Constant);
+        else if (behavior == L"Increment") trainer->SetAllBehaviors(Trainer::RngBehavior::Increment);
+        else if (behavior == L"Randomize") trainer->SetAllBehaviors(Trainer::RngBehavior::Randomize);
+        else {
+            MessageBoxW(g_hwnd, L"Valid RNG behaviors are:\nConstant, Increment, Randomize", L"Invalid RNG behavior", MB_TASKMODAL | MB_ICONHAND | MB_OK | MB_SETFOREGROUND);
+            return;
+        }
+        PublishViewModel([&behavior](ViewModel& model) { model.behaviors.fill(behavior); });
+    } else if (command == LOAD_DECKLISTS) {
+        std::array<std::optional<std::wstring>, 3> deckLists;
+        trainer->UpdateDecks([&deckLists](size_t slot, const DeckDecoder::Deck& deck) {
+            std::wstring list;
+            for (const auto& card : deck.cards) {
+                list += card.name;
+                list += L'\n';
+            }
+            deckLists[slot] = std::move(list);
+        });
+        if (std::any_of(deckLists.begin(), deckLists.end(), [](const auto& list) { return list.has_value(); })) {
+            PublishViewModel([&deckLists](ViewModel& model) {
+                for (size_t slot = 0; slot < deckLists.size(); slot++) {
+                    if (deckLists[slot]) model.deckLists[slot] = *deckLists[slot];
+                }
+            });
+        }
+
+        // Every draft counts towards the stats, even if it offered the same deck as last time.
+        std::wstring draftStats;
+        trainer->ReadDraftStats([&draftStats](const DraftStats& stats) { draftStats = FormatDraftStats(stats); });
+        if (draftStats != std::atomic_load(&g_viewModel)->draftStats) {
+            PublishViewModel([&draftStats](ViewModel& model) { model.draftStats = draftStats; });
+        }
+    } else if (command == POLL_RNG_COUNTERS) {
+        Trainer::RngCounters counters = trainer->PollRngCounters();
+        if (counters.classDraws.empty()) return;
+        auto format = [](uint64_t draws, double drawsPerSecond) {
+            return L"Draws: " + std::to_wstring(draws) + L" (" + std::to_wstring(std::llround(drawsPerSecond)) + L"/s)";
+        };
+        PublishViewModel([&counters, &format](ViewModel& model) {
+            uint64_t totalDraws = 0;
+            double totalDrawsPerSecond = 0.0;
+            for (int i = 0; i < Trainer::RngClass::NumEntries; i++) {
+                model.rngDraws[i] = format(counters.classDraws[i], counters.classDrawsPerSecond[i]);
+                totalDraws += counters.classDraws[i];
+                totalDrawsPerSecond += counters.classDrawsPerSecond[i];
+            }
+            model.rngDraws[Trainer::RngClass::NumEntries] = format(totalDraws, totalDrawsPerSecond);
+        });
+    } else if (command == RECORD_RNG_DRAWS) {
+        bool recording = std::atomic_load(&g_viewModel)->recordingRng;
+        if (recording) {
+            trainer->StopRngRecording();
+        } else {
+            // Each recording gets its own log, so that two runs can be diffed afterwards.
+            SYSTEMTIME time;
+            GetLocalTime(&time);
+            wchar_t name[64];
+            swprintf_s(name, L"RngDraws-%04d%02d%02d-%02d%02d%02d.rnglog", time.wYear, time.wMonth, time.wDay, time.wHour, time.wMinute, time.wSecond);
+            if (!trainer->StartRngRecording(name)) {
+                MessageBoxW(g_hwnd, L"RNG draws can only be recorded once the game is derandomized, and the log next to the trainer can be created.", L"Could not record", MB_TASKMODAL | MB_ICONHAND | MB_OK | MB_SETFOREGROUND);
+                return;
+            }
+        }
+        PublishViewModel([recording](ViewModel& model) { model.recordingRng = !recording; });
+    } else if (command >= FORCE_SLOT_1 && command <= FORCE_SLOT_3) {
+        auto action = HIWORD(wParam);
+        int slot = command - FORCE_SLOT_1 + 1;
+        if (action == CBN_SELCHANGE) {
+            int selectedIndex = input.selectedIndex;
+            if (selectedIndex == 0) {
+                trainer->ForceRoomDraft(L"", slot);
+            } else {
+                const std::wstring internalName = ROOM_NAMES[selectedIndex - 1].second;
+                if (!trainer->ForceRoomDraft(internalName, slot)) {
+                    MessageBoxW(g_hwnd, (L"The game does not have a room named " + internalName).c_str(), L"Invalid room", MB_TASKMODAL | MB_ICONHAND | MB_OK | MB_SETFOREGROUND);
+                }
+            }
+        }
+    }
+}
+
 LRESULT CALLBACK WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam) {
     switch (message) {
         case WM_DESTROY:
@@ -112,7 +295,10 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
 
             // Signal to stop all work on background threads (and not start new work)
             KillTimer(g_hwnd, LOAD_DECKLISTS);
+            KillTimer(g_hwnd, POLL_RNG_COUNTERS);
+            KillTimer(g_hwnd, RENDER_VIEW_MODEL);
             g_trainer->StopHeartbeat();
+            g_commands->Stop();
 
             // Pump messages until (presumably) all threads are done with work
             while (trainer.use_count() > 1) {
@@ -161,102 +347,62 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
             case ProcStatus::Stopped:
             case ProcStatus::NotRunning:
                 // Reset the title & launch text but nothing else (trainer manages itself).
-                SetStringText(g_hwnd, L"Waiting for Blue Prince to start...");
+                PublishViewModel([](ViewModel& model) {
+                    model.title = L"Waiting for Blue Prince to start...";
+                    model.recordingRng = false; // The trainer stops recording when the game exits
+                });
                 KillTimer(g_hwnd, LOAD_DECKLISTS);
+                KillTimer(g_hwnd, POLL_RNG_COUNTERS);
                 break;
             case ProcStatus::Started:
                 // Process just started, enforce our settings.
                 SetTimer(g_hwnd, LOAD_DECKLISTS, 1000, (TIMERPROC)NULL); // Reload decklists every second
+#if DERANDOMIZE
+                SetTimer(g_hwnd, POLL_RNG_COUNTERS, 1000, (TIMERPROC)NULL); // And the RNG draw counters
+#endif
                 [[fallthrough]];
             case ProcStatus::Reload:
                 // Or, we started a new game / loaded a save, in which case some of the entity data might have been reset. Basically the same.
-                SetStringText(g_hwnd, L"Attaching to Blue Prince...");
+                PublishViewModel([](ViewModel& model) { model.title = L"Attaching to Blue Prince..."; });
                 break;
             case ProcStatus::AlreadyRunning:
                 // Process was already running, and we just started. Load settings from the game.
-                SetStringText(g_hwnd, WINDOW_TITLE);
+                PublishViewModel([](ViewModel& model) { model.title = WINDOW_TITLE; });
                 SetTimer(g_hwnd, LOAD_DECKLISTS, 1000, (TIMERPROC)NULL); // Reload decklists every second
+#if DERANDOMIZE
+                SetTimer(g_hwnd, POLL_RNG_COUNTERS, 1000, (TIMERPROC)NULL); // And the RNG draw counters
+#endif
                 break;
             case ProcStatus::Running:
-                // Process was already running, and so were we (this recurs every heartbeat). Enforce settings and apply repeated actions.
+                // Process was already running, and so were we (we only hear about this once, after any other state).
                 break;
             }
             return 0;
         case WM_TIMER:
+            if (wParam == RENDER_VIEW_MODEL) {
+                RenderViewModel();
+                return 0;
+            }
+            break; // Any other timer is a command, handled below
         case WM_COMMAND:
             break; // LOWORD(wParam) contains the actual command, handled below
         default:
             return DefWindowProc(hwnd, message, wParam, lParam);
     }
 
-    // All commands should execute on a background thread, to avoid hanging the UI.
-    std::thread t([trainer = g_trainer, wParam, lParam] {
+    // All commands execute on the command workers, to avoid hanging the UI, with the inputs they had when posted. The full wParam is the key, so that different notifications
+    // from the same control are kept apart. Reloads, polls and "Set" buttons only need their latest run, so a pending one absorbs any repeats;
+    // everything else (e.g. the recording toggle, which flips state) must run once per message.
+    WORD command = LOWORD(wParam);
+    bool coalesce = command == LOAD_DECKLISTS || command == POLL_RNG_COUNTERS
+        || (command >= SET_SEED_UNKNOWN && command <= SET_SEED_ALL)
+        || (command >= SET_BEHAVIOR_UNKNOWN && command <= SET_BEHAVIOR_ALL);
+    g_commands->Post(wParam, [trainer = g_trainer, wParam, input = ReadCommandInput(wParam, lParam)] {
 #pragma warning(disable: 4101)
-        void* g_trainer; // This thread must hold a local reference to g_trainer, to avoid it being freed while the thread is running.
-        SetCurrentThreadName(L"Command Helper");
+        void* g_trainer; // This command must hold a local reference to g_trainer, to avoid it being freed while the command is running.
         if (!trainer || !trainer->HeartbeatActive()) return; // We are shutting down, do not process any actions
-
-        WORD command = LOWORD(wParam);
-        if (command >= SET_SEED_UNKNOWN && command < SET_SEED_UNKNOWN + Trainer::RngClass::NumEntries) {
-            Trainer::RngClass rngClass = (Trainer::RngClass)(command - SET_SEED_UNKNOWN);
-            __int64 seed = std::stoull(GetWindowString(g_seedInputs[rngClass]));
-            trainer->SetSeed(rngClass, seed);
-        } else if (command == SET_SEED_ALL) {
-            __int64 seed = std::stoull(GetWindowString(g_seedInputs[Trainer::RngClass::NumEntries]));
-            trainer->SetAllSeeds(seed);
-            for (HWND hwnd : g_seedInputs) SetStringText(hwnd, std::to_string(seed));
-        } else if (command >= SET_BEHAVIOR_UNKNOWN && command < SET_BEHAVIOR_UNKNOWN + Trainer::RngClass::NumEntries) {
-            Trainer::RngClass rngClass = (Trainer::RngClass)(command - SET_BEHAVIOR_UNKNOWN);
-            std::wstring behavior = GetWindowString(g_behaviorInputs[rngClass]);
-            if (behavior == L"Constant") trainer->SetRngBehavior(rngClass, Trainer::RngBehavior::Constant);
-            else if (behavior == L"Increment") trainer->SetRngBehavior(rngClass, Trainer::RngBehavior::Increment);
-            else if (behavior == L"Randomize") trainer->SetRngBehavior(rngClass, Trainer::RngBehavior::Randomize);
-            else {
-                MessageBoxW(g_hwnd, L"Valid RNG behaviors are:\nConstant, Increment, Randomize", L"Invalid RNG behavior", MB_TASKMODAL | MB_ICONHAND | MB_OK | MB_SETFOREGROUND);
-                return;
-            }
-        } else if (command == SET_BEHAVIOR_ALL) {
-            std::wstring behavior = GetWindowString(g_behaviorInputs[Trainer::RngClass::NumEntries]);
-            if (behavior == L"Constant") trainer->SetAllBehaviors(Trainer::RngBehavior::Constant);
-            else if (behavior == L"Increment") trainer->SetAllBehaviors(Trainer::RngBehavior::Increment);
-            else if (behavior == L"Randomize") trainer->SetAllBehaviors(Trainer::RngBehavior::Randomize);
-            else {
-                MessageBoxW(g_hwnd, L"Valid RNG behaviors are:\nConstant, Increment, Randomize", L"Invalid RNG behavior", MB_TASKMODAL | MB_ICONHAND | MB_OK | MB_SETFOREGROUND);
-                return;
-            }
-            for (HWND hwnd : g_behaviorInputs) SetStringText(hwnd, behavior);
-        } else if (command == LOAD_DECKLISTS) {
-            std::vector<std::vector<std::wstring>> decks = trainer->GetDecks();
-            int i = 0;
-            for (const auto& deck : decks) {
-                std::wstring list;
-                for (const std::wstring& card : decks[i]) {
-                    if (card[0] == L'<') { // Weirdly, some cards have color labels. Remove them.
-                        assert(card.size() > 23, "Output card had <tags> but was not 23 characters");
-                        list += card.substr(15, card.size() - 23) + L'\n';
-                    } else {
-                        list += card + L'\n';
-                    }
-                }
-                SetStringText(g_deckLists[i], list);
-                i++;
-                if (i >= 3) break;
-            }
-        } else if (command >= FORCE_SLOT_1 && command <= FORCE_SLOT_3) {
-            auto action = HIWORD(wParam);
-            int slot = command - FORCE_SLOT_1 + 1;
-            if (action == CBN_SELCHANGE) {
-                int selectedIndex = (int)SendMessage((HWND)lParam, (UINT)CB_GETCURSEL, NULL, NULL);
-                if (selectedIndex == 0) {
-                    trainer->ForceRoomDraft(L"", slot);
-                } else {
-                    const std::wstring internalName = ROOM_NAMES[selectedIndex - 1].second;
-                    trainer->ForceRoomDraft(internalName, slot);
-                }
-            }
-        }
-    });
-    t.detach();
+        ExecuteCommand(trainer, wParam, input);
+    }, coalesce);
 
     return DefWindowProc(hwnd, message, wParam, lParam);
 }
@@ -326,6 +472,14 @@ HWND CreateDropdown(int& x, int& y, int width, const std::vector<std::wstring>&
 }
 
 void CreateComponents() {
+    // The controls start out showing the initial snapshot.
+    auto model = std::make_shared<ViewModel>();
+    model->title = WINDOW_TITLE;
+    model->seeds.fill(L"42");
+    model->behaviors.fill(L"Constant");
+    std::atomic_store(&g_viewModel, std::shared_ptr<const ViewModel>(model));
+    g_renderedViewModel = model;
+
     int y = 10;
 #if DERANDOMIZE
     std::vector<const wchar_t*> categories = {L"Unknown", L"DoNotTamper", L"BirdPathing", L"Rarity", L"Drafting", L"Items", L"DogSwapper", L"Trading", L"Derigiblock", L"SlotMachine", L"All"};
@@ -333,17 +487,21 @@ void CreateComponents() {
         int x = 10;
         CreateLabel(x, y + 5, 100, categories[i]);
         CreateLabel(x, y + 5, 40, L"Seed:");
-        g_seedInputs[i] = CreateText(x, y, 100, L"42");
+        g_seedInputs[i] = CreateText(x, y, 100, model->seeds[i].c_str());
         CreateButton(x, y, 40, L"Set", SET_SEED_UNKNOWN + i);
 
         x += 10;
 
         CreateLabel(x, y + 5, 65, L"Behavior:");
-        g_behaviorInputs[i] = CreateText(x, y, 80, L"Constant");
+        g_behaviorInputs[i] = CreateText(x, y, 80, model->behaviors[i].c_str());
         CreateButton(x, y, 40, L"Set", SET_BEHAVIOR_UNKNOWN + i);
 
+        x += 10;
+        g_rngDraws[i] = CreateLabel(x, y + 5, 130, L"");
+
         y += 30;
     }
+    CreateLabelAndCheckbox(10, y, 140, L"Record RNG draws:", RECORD_RNG_DRAWS);
     y += 30;
 #endif
 
@@ -352,6 +510,7 @@ void CreateComponents() {
     CreateLabel(x, y, deckWidth, L"Deck 1");
     CreateLabel(x, y, deckWidth, L"Deck 2");
     CreateLabel(x, y, deckWidth, L"Deck 3");
+    CreateLabel(x, y, deckWidth, L"Draft stats");
     y += 20;
 
     x = 10;
@@ -371,6 +530,10 @@ void CreateComponents() {
             x + i * deckWidth, y, 120, 300,
             g_hwnd, (HMENU)NULL, g_hInstance, NULL);
     }
+    g_draftStats = CreateWindow(L"STATIC", L"",
+        WS_VISIBLE | WS_CHILD | SS_LEFT,
+        x + 3 * deckWidth, y - 25, 140, 325,
+        g_hwnd, (HMENU)NULL, g_hInstance, NULL);
     y += 30;
 }
 
@@ -408,7 +571,7 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance
 
     int height = 400;
 #if DERANDOMIZE
-    height += 300;
+    height += 330;
 #endif
 
     RECT rect;
@@ -422,9 +585,15 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance
     g_hInstance = hInstance;
 
     CreateComponents();
+    SetTimer(g_hwnd, RENDER_VIEW_MODEL, s_renderInterval, (TIMERPROC)NULL);
 
+    // A small, fixed pool: commands with the same key never run concurrently, so extra workers only help unrelated commands.
+    g_commands = std::make_unique<CommandQueue>(2, L"Command Helper");
     g_bluePrinceProc = std::make_shared<Memory>(L"BLUE PRINCE.exe", L"GameAssembly.dll");
     g_trainer = std::make_shared<Trainer>(g_bluePrinceProc);
+    std::vector<std::wstring> internalNames;
+    for (const auto& [key, value] : ROOM_NAMES) internalNames.push_back(value);
+    g_trainer->SetRoomNames(internalNames);
     g_trainer->StartHeartbeat(g_hwnd, HEARTBEAT);
 
     MSG msg;
@@ -433,6 +602,7 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance
         DispatchMessage(&msg);
     }
 
+    g_commands = nullptr; // Joins the workers, which have all finished by now (see WM_DESTROY)
     CoUninitialize();
     return (int)msg.wParam;
 }
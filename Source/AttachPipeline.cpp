@@ -0,0 +1,85 @@
+#include "pch.h"
+#include "AttachPipeline.h"
+
+namespace {
+    const char* s_stageNames[] = {"Declare", "Scan", "Resolve", "Allocate", "Assemble", "Patch"};
+    static_assert(std::size(s_stageNames) == AttachPipeline::Stage::NumStages);
+}
+
+void AttachPipeline::AddStep(const std::string& feature, Stage stage, const Step& step) {
+    assert(stage != Stage::Scan && stage < Stage::Patch, "[INTERNAL ERROR] The scan and patch stages do not take steps");
+    auto search = std::find_if(_features.begin(), _features.end(), [&feature](const Feature& f) { return f.name == feature; });
+    if (search == _features.end()) {
+        _features.push_back(Feature{feature});
+        search = _features.end() - 1;
+    }
+    search->steps[stage] = step;
+}
+
+bool AttachPipeline::Run(Memory& memory, const CancellationToken& token) {
+    for (int stage = 0; stage < Stage::Patch; stage++) {
+        if (token.IsCancelled()) {
+            Cancel(memory, s_stageNames[stage]);
+            return false;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        if (stage == Stage::Scan) {
+            // Each feature checks its own results (in the resolve stage), so the number of missing scans is only logged.
+            (void)memory.ExecuteSigScans();
+            _stageTimes[stage] = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+            DebugPrint(std::string("Attach stage Scan took ") + std::to_string(_stageTimes[stage].count()) + " us");
+            continue;
+        }
+
+        std::vector<std::future<bool>> results(_features.size());
+        for (size_t i = 0; i < _features.size(); i++) {
+            Feature& feature = _features[i];
+            if (feature.failed || !feature.steps[stage]) continue;
+            results[i] = std::async(std::launch::async, [&feature, stage] {
+                SetCurrentThreadName(L"Attach");
+                return feature.steps[stage](feature.patch);
+            });
+        }
+        for (size_t i = 0; i < _features.size(); i++) {
+            if (!results[i].valid() || results[i].get()) continue;
+            _features[i].failed = true;
+            DebugPrint("Failed to attach " + _features[i].name + " (in stage " + s_stageNames[stage] + ")");
+            // Drop anything the feature allocated or journaled (and any edits restored from the journal), so that a restarted trainer tries it again.
+            memory.RemoveFeature(_features[i].name);
+        }
+        _stageTimes[stage] = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        DebugPrint(std::string("Attach stage ") + s_stageNames[stage] + " took " + std::to_string(_stageTimes[stage].count()) + " us");
+    }
+
+    // Nothing has touched the game code yet, so this is the last point at which we can back out cleanly.
+    if (token.IsCancelled()) {
+        Cancel(memory, s_stageNames[Stage::Patch]);
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    Memory::PatchTransaction patch;
+    for (const auto& feature : _features) {
+        if (!feature.failed) patch.Append(feature.patch);
+    }
+    if (!memory.Commit(patch)) {
+        // The commit is all or nothing, so every feature which had edits in it is dropped (features restored from the journal had none).
+        for (auto& feature : _features) {
+            if (feature.failed || feature.patch.Empty()) continue;
+            feature.failed = true;
+            DebugPrint("Failed to attach " + feature.name + " (in stage Patch)");
+            memory.RemoveFeature(feature.name);
+        }
+    }
+    _stageTimes[Stage::Patch] = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    DebugPrint("Attach stage Patch took " + std::to_string(_stageTimes[Stage::Patch].count()) + " us");
+    return true;
+}
+
+void AttachPipeline::Cancel(Memory& memory, const char* stageName) {
+    DebugPrint(std::string("Attach cancelled before stage ") + stageName);
+    // Features restored from the journal are left alone, but anything the other features allocated (or journaled) would otherwise leak.
+    for (const auto& feature : _features) {
+        if (!feature.failed && !memory.HasFeature(feature.name)) memory.RemoveFeature(feature.name);
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <array>
+
+// The attach sequence, as a fixed series of stages. Each feature contributes (at most) one step to each stage; the steps of a stage run
+// in parallel, and a stage only starts once the previous one is done. So each stage takes as long as its slowest step, not the sum of them.
+// Features declare their sigscans first, and the pipeline then runs all of them in a single pass over the module.
+// Steps only prepare their feature's edits (into the feature's own PatchTransaction). Game code is not touched until the final Patch stage,
+// which commits the edits of every feature at once (if that fails, every feature in it fails). A feature whose step fails is removed (see Memory::RemoveFeature), so that it is not journaled
+// and a restarted trainer tries it again. A cancelled pipeline stops between stages without committing anything, and frees what it allocated.
+class AttachPipeline final {
+public:
+    enum Stage {
+        Declare,    // Add the sigscans for the feature
+        Scan,       // Run every sigscan (this stage belongs to the pipeline)
+        Resolve,    // Check the scan results, and derive addresses from them
+        Allocate,   // Allocate (and fill in) our own memory in the game process
+        Assemble,   // Write our code, and collect the edits to game code
+        Patch,      // Commit every feature's edits (this stage belongs to the pipeline)
+        NumStages,
+    };
+    using Step = std::function<bool(Memory::PatchTransaction& patch)>; // Returns false if the feature can't be applied
+
+    void AddStep(const std::string& feature, Stage stage, const Step& step);
+    // Returns false if the pipeline was cancelled, in which case none of the edits were committed.
+    bool Run(Memory& memory, const CancellationToken& token);
+    std::chrono::microseconds GetStageTime(Stage stage) const { return _stageTimes[stage]; }
+
+private:
+    struct Feature {
+        std::string name;
+        std::array<Step, Stage::NumStages> steps;
+        Memory::PatchTransaction patch;
+        bool failed = false;
+    };
+    std::vector<Feature> _features;
+    std::array<std::chrono::microseconds, Stage::NumStages> _stageTimes = {};
+    void Cancel(Memory& memory, const char* stageName);
+};
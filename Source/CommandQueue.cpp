@@ -0,0 +1,68 @@
+#include "pch.h"
+#include "CommandQueue.h"
+
+CommandQueue::CommandQueue(size_t numWorkers, const wchar_t* threadName) {
+    for (size_t i = 0; i < numWorkers; i++) _workers.emplace_back(&CommandQueue::Work, this, threadName);
+}
+
+CommandQueue::~CommandQueue() {
+    Stop();
+    for (auto& worker : _workers) worker.join();
+}
+
+void CommandQueue::Post(uint64_t key, Command command, bool coalesce) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_stopping) return;
+
+    Lane& lane = _lanes[key];
+    if (coalesce && !lane.pending.empty()) {
+        lane.pending.back() = std::move(command);
+        return;
+    }
+    lane.pending.push_back(std::move(command));
+    if (!lane.running && lane.pending.size() == 1) {
+        _ready.push_back(key);
+        _workAvailable.notify_one();
+    }
+}
+
+void CommandQueue::Stop() {
+    std::deque<Command> dropped; // Commands may own references (e.g. to the trainer), so release them outside of the lock.
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+        for (auto& [key, lane] : _lanes) {
+            for (auto& command : lane.pending) dropped.push_back(std::move(command));
+            lane.pending.clear();
+        }
+        _ready.clear();
+    }
+    _workAvailable.notify_all();
+}
+
+void CommandQueue::Work(const wchar_t* threadName) {
+    SetCurrentThreadName(threadName);
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _workAvailable.wait(lock, [this] { return _stopping || !_ready.empty(); });
+        if (_stopping) return;
+
+        uint64_t key = _ready.front();
+        _ready.pop_front();
+        Lane& lane = _lanes[key];
+        Command command = std::move(lane.pending.front());
+        lane.pending.pop_front();
+        lane.running = true;
+
+        lock.unlock();
+        command();
+        command = nullptr; // Release anything the command owns before reporting that it's done
+        lock.lock();
+
+        lane.running = false;
+        if (!lane.pending.empty() && !_stopping) {
+            _ready.push_back(key);
+            _workAvailable.notify_one();
+        }
+    }
+}
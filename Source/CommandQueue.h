@@ -0,0 +1,35 @@
+#pragma once
+#include <deque>
+#include <mutex>
+
+// A fixed pool of worker threads, which run commands posted from the UI thread (so that the UI never waits on the game).
+// Commands are grouped by key: commands with the same key run in the order they were posted, and never concurrently.
+// A coalescing command replaces any command with the same key which has not started yet, so repeated idempotent commands
+// (e.g. timer ticks while the game is slow to respond) collapse into one, rather than piling up behind each other.
+class CommandQueue final {
+public:
+    using Command = std::function<void()>;
+
+    CommandQueue(size_t numWorkers, const wchar_t* threadName);
+    ~CommandQueue();
+    CommandQueue(const CommandQueue& other) = delete;
+    CommandQueue& operator=(const CommandQueue& other) = delete;
+
+    void Post(uint64_t key, Command command, bool coalesce);
+    void Stop(); // Drops any pending commands, and tells the workers to exit once their current command is done. Does not wait for them.
+
+private:
+    void Work(const wchar_t* threadName);
+
+    struct Lane {
+        std::deque<Command> pending;
+        bool running = false;
+    };
+
+    std::mutex _mutex;
+    std::condition_variable _workAvailable;
+    std::map<uint64_t, Lane> _lanes;
+    std::deque<uint64_t> _ready; // Lanes which have pending commands, and no command running
+    bool _stopping = false;
+    std::vector<std::thread> _workers;
+};
@@ -0,0 +1,104 @@
+#include "pch.h"
+#include "DeckDecoder.h"
+
+bool DeckDecoder::Decode(const std::vector<uint64_t>& templates, const ResolveName& resolveName) {
+    for (auto& deck : _decks) deck.changed = false;
+
+    for (uint64_t roomTemplate : templates) {
+        if (_expectSlot) {
+            _expectSlot = false;
+            if (roomTemplate >= 1 && roomTemplate <= s_numSlots) {
+                _incomingSlot = static_cast<size_t>(roomTemplate - 1);
+            } else {
+                DebugPrint("Dropped a deck for unknown slot " + std::to_string(roomTemplate));
+                _dropIncoming = true;
+            }
+        } else if (_expectOverride) {
+            _expectOverride = false;
+            _expectDrawn = true;
+            _incomingOverride = roomTemplate;
+        } else if (_expectDrawn) {
+            _expectDrawn = false;
+            FinishDeck({roomTemplate, roomTemplate != 0 ? resolveName(roomTemplate) : std::wstring_view()});
+        } else if (roomTemplate == 0) {
+            _expectOverride = true;
+        } else if (_dropIncoming) {
+            continue;
+        } else if (_incoming.size() < s_maxDeckSize) {
+            _incoming.push_back({roomTemplate, resolveName(roomTemplate)});
+        } else {
+            DebugPrint("Dropped a deck with more than " + std::to_string(s_maxDeckSize) + " cards");
+            _dropIncoming = true;
+        }
+    }
+
+    bool anyChanged = false;
+    for (size_t slot = 0; slot < s_numSlots; slot++) {
+        Deck& deck = _decks[slot];
+        if (!deck.changed) continue;
+        ComputeDiff(deck, _previous[slot]);
+        anyChanged |= deck.changed;
+    }
+    return anyChanged;
+}
+
+void DeckDecoder::Reset() {
+    for (size_t slot = 0; slot < s_numSlots; slot++) {
+        _decks[slot].cards.clear();
+        _decks[slot].changed = false;
+        _previous[slot].clear();
+    }
+    _incoming.clear();
+    _dropIncoming = false;
+    _expectSlot = true;
+    _expectOverride = false;
+    _expectDrawn = false;
+}
+
+void DeckDecoder::FinishDeck(const Card& drawn) {
+    _expectSlot = true;
+    if (_dropIncoming) {
+        _incoming.clear();
+        _dropIncoming = false;
+        return;
+    }
+
+    // The first deck for a slot in each call keeps the slot's old cards, so they can be diffed at the end. Every swap keeps the vectors' capacity.
+    Deck& deck = _decks[_incomingSlot];
+    if (!deck.changed) {
+        std::swap(_previous[_incomingSlot], deck.cards);
+        deck.changed = true;
+    }
+    std::swap(deck.cards, _incoming);
+    _incoming.clear();
+    deck.drawn = drawn;
+    deck.roomOverride = _incomingOverride;
+    if (_onDeck) _onDeck(_incomingSlot, deck);
+}
+
+void DeckDecoder::ComputeDiff(Deck& deck, const std::vector<Card>& previous) {
+    deck.added.clear();
+    deck.removed.clear();
+    if (deck.cards == previous) {
+        deck.changed = false;
+        deck.reordered = false;
+        return;
+    }
+
+    // Decks are small, so a quadratic multiset comparison (without any scratch memory) is cheaper than sorting copies.
+    // A card which appears n times in one deck and m times in the other is added (or removed) |n - m| times.
+    auto count = [](const std::vector<Card>& cards, size_t end, uint64_t roomTemplate) {
+        size_t n = 0;
+        for (size_t i = 0; i < end; i++) n += (cards[i].roomTemplate == roomTemplate);
+        return n;
+    };
+    for (size_t i = 0; i < deck.cards.size(); i++) {
+        const Card& card = deck.cards[i];
+        if (count(deck.cards, i + 1, card.roomTemplate) > count(previous, previous.size(), card.roomTemplate)) deck.added.push_back(card.name);
+    }
+    for (size_t i = 0; i < previous.size(); i++) {
+        const Card& card = previous[i];
+        if (count(previous, i + 1, card.roomTemplate) > count(deck.cards, deck.cards.size(), card.roomTemplate)) deck.removed.push_back(card.name);
+    }
+    deck.reordered = deck.added.empty() && deck.removed.empty();
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <string_view>
+
+// Incrementally decodes the decks written by the draft hook (see Trainer::InjectDraftWatcher): the slot being drafted (RoomDraftContext.CurrentSlot,
+// which counts from 1), a list of RoomTemplate pointers, then a null pointer, then the override which the hook used for the slot (or null),
+// then the RoomTemplate which was drawn from the deck (or null).
+// Parse state is kept between calls (including a deck which is only partially read), and every buffer is reused,
+// so that decoding does not allocate once the decks have reached their usual size.
+class DeckDecoder final {
+public:
+    static constexpr size_t s_numSlots = 3;
+    static constexpr size_t s_maxDeckSize = 0x400; // Anything longer is not a deck; it is dropped.
+
+    struct Card {
+        uint64_t roomTemplate;
+        std::wstring_view name;
+        bool operator==(const Card& other) const { return roomTemplate == other.roomTemplate; }
+    };
+
+    struct Deck {
+        std::vector<Card> cards;
+        Card drawn = {}; // The room which the game put into this slot (either the top card, or a forced room)
+        uint64_t roomOverride = 0; // The slot's override when the deck was drawn, exactly as the trainer wrote it (see Trainer::ForceRoomDraft)
+        // Differences from this slot's deck before the last call to Decode. Only meaningful if changed is true.
+        bool changed = false;
+        bool reordered = false; // The same cards, in a different order
+        std::vector<std::wstring_view> added;
+        std::vector<std::wstring_view> removed;
+    };
+
+    // The names must remain valid as long as the decoder refers to them.
+    using ResolveName = std::function<std::wstring_view(uint64_t roomTemplate)>;
+    // Returns true if any deck changed.
+    bool Decode(const std::vector<uint64_t>& templates, const ResolveName& resolveName);
+    // Called for every deck as it is decoded (unlike the diffs, which only cover each slot's latest deck). Optional.
+    using OnDeck = std::function<void(size_t slot, const Deck& deck)>;
+    void SetOnDeck(const OnDeck& onDeck) { _onDeck = onDeck; }
+    const Deck& GetDeck(size_t slot) const { return _decks[slot]; }
+    void Reset();
+
+private:
+    void FinishDeck(const Card& drawn);
+    void ComputeDiff(Deck& deck, const std::vector<Card>& previous);
+
+    Deck _decks[s_numSlots];
+    std::vector<Card> _previous[s_numSlots]; // What each slot held before this call to Decode
+    std::vector<Card> _incoming; // The deck which is currently being parsed
+    size_t _incomingSlot = 0;
+    uint64_t _incomingOverride = 0;
+    bool _dropIncoming = false;
+    bool _expectSlot = true; // The next value is the slot, which starts a deck
+    bool _expectOverride = false; // The next value is the override, after the deck's null terminator
+    bool _expectDrawn = false; // The next template is the drawn room, which ends the deck
+    OnDeck _onDeck;
+};
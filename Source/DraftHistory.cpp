@@ -0,0 +1,175 @@
+#include "pch.h"
+#include "DraftHistory.h"
+
+namespace {
+    // Name, width of each value
+    const std::pair<const wchar_t*, size_t> s_eventColumns[] = {
+        {L"timestamp.col", sizeof(int64_t)},
+        {L"slot.col", sizeof(uint8_t)},
+        {L"forced.col", sizeof(uint16_t)},
+        {L"drawn.col", sizeof(uint16_t)},
+        {L"deckEnd.col", sizeof(uint32_t)},
+    };
+
+    std::vector<std::wstring> ReadRoomDictionary(const std::filesystem::path& path) {
+        std::vector<std::wstring> names;
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) return names;
+        std::wstring data(static_cast<size_t>(file.tellg()) / sizeof(wchar_t), L'\0');
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(wchar_t));
+
+        for (size_t start = 0; start < data.size();) {
+            size_t end = data.find(L'\n', start);
+            if (end == std::wstring::npos) break; // An unterminated name was not completely written
+            names.push_back(data.substr(start, end - start));
+            start = end + 1;
+        }
+        return names;
+    }
+}
+
+bool DraftHistoryWriter::Open(const std::wstring& directory) {
+    Close();
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) return false;
+    _directory = directory;
+
+    _roomIds.clear();
+    std::vector<std::wstring> names = ReadRoomDictionary(_directory / L"rooms.dict");
+    size_t dictionarySize = 0;
+    for (size_t i = 0; i < names.size(); i++) {
+        _roomIds.emplace(names[i], static_cast<uint16_t>(i + 1));
+        dictionarySize += (names[i].size() + 1) * sizeof(wchar_t);
+    }
+    // Drop an unterminated name (which the reader skips), so that the next name we add does not get appended to it.
+    auto dictionary = _directory / L"rooms.dict";
+    if (std::filesystem::exists(dictionary)) std::filesystem::resize_file(dictionary, dictionarySize, error);
+
+    // If a previous writer was interrupted mid-flush, drop any partially written events, so that every column lines up again.
+    size_t numEvents = SIZE_MAX;
+    for (const auto& [name, width] : s_eventColumns) {
+        auto path = _directory / name;
+        size_t size = std::filesystem::exists(path) ? static_cast<size_t>(std::filesystem::file_size(path)) : 0;
+        numEvents = std::min(numEvents, size / width);
+    }
+    _deckEnd = 0;
+    if (numEvents > 0) {
+        std::ifstream deckEnds(_directory / L"deckEnd.col", std::ios::binary);
+        deckEnds.seekg((numEvents - 1) * sizeof(uint32_t));
+        deckEnds.read(reinterpret_cast<char*>(&_deckEnd), sizeof(_deckEnd));
+    }
+    for (const auto& [name, width] : s_eventColumns) {
+        auto path = _directory / name;
+        if (std::filesystem::exists(path)) std::filesystem::resize_file(path, numEvents * width, error);
+    }
+    auto deckRooms = _directory / L"deckRooms.col";
+    if (std::filesystem::exists(deckRooms)) std::filesystem::resize_file(deckRooms, _deckEnd * sizeof(uint16_t), error);
+    return true;
+}
+
+uint16_t DraftHistoryWriter::GetRoomId(std::wstring_view name) {
+    if (name.empty()) return 0;
+    auto search = _roomIds.find(name);
+    if (search != _roomIds.end()) return search->second;
+    if (_roomIds.size() >= UINT16_MAX) return 0;
+
+    uint16_t roomId = static_cast<uint16_t>(_roomIds.size() + 1);
+    _roomIds.emplace(std::wstring(name), roomId);
+    _newRooms.emplace_back(name);
+    return roomId;
+}
+
+void DraftHistoryWriter::Append(int64_t timestamp, uint8_t slot, uint16_t forced, uint16_t drawn, const std::vector<uint16_t>& deck) {
+    if (!IsOpen()) return;
+    _timestamps.push_back(timestamp);
+    _slots.push_back(slot);
+    _forced.push_back(forced);
+    _drawn.push_back(drawn);
+    _deckRooms.insert(_deckRooms.end(), deck.begin(), deck.end());
+    _deckEnd += static_cast<uint32_t>(deck.size());
+    _deckEnds.push_back(_deckEnd);
+}
+
+template <class T>
+void DraftHistoryWriter::AppendColumn(const wchar_t* name, std::vector<T>& values) {
+    if (values.empty()) return;
+    std::ofstream file(_directory / name, std::ios::binary | std::ios::app);
+    file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    values.clear();
+}
+
+void DraftHistoryWriter::Flush() {
+    if (!IsOpen()) return;
+
+    // The dictionary and the deck rooms are written before the events which refer to them.
+    if (!_newRooms.empty()) {
+        std::wstring names;
+        for (const auto& name : _newRooms) names += name + L'\n';
+        std::ofstream file(_directory / L"rooms.dict", std::ios::binary | std::ios::app);
+        file.write(reinterpret_cast<const char*>(names.data()), names.size() * sizeof(wchar_t));
+        _newRooms.clear();
+    }
+    AppendColumn(L"deckRooms.col", _deckRooms);
+    AppendColumn(L"deckEnd.col", _deckEnds);
+    AppendColumn(L"slot.col", _slots);
+    AppendColumn(L"forced.col", _forced);
+    AppendColumn(L"drawn.col", _drawn);
+    AppendColumn(L"timestamp.col", _timestamps);
+}
+
+void DraftHistoryWriter::Close() {
+    Flush();
+    _directory.clear();
+}
+
+bool MappedColumn::Open(const std::filesystem::path& path) {
+    Close();
+    _file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (_file == INVALID_HANDLE_VALUE) return GetLastError() == ERROR_FILE_NOT_FOUND;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(_file, &size)) return false;
+    _size = static_cast<size_t>(size.QuadPart);
+    if (_size == 0) return true; // Empty files can't be mapped
+
+    _mapping = CreateFileMappingW(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (_mapping == nullptr) return false;
+    _view = MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+    return _view != nullptr;
+}
+
+void MappedColumn::Close() {
+    if (_view != nullptr) UnmapViewOfFile(_view);
+    if (_mapping != nullptr) CloseHandle(_mapping);
+    if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+    _view = nullptr;
+    _mapping = nullptr;
+    _file = INVALID_HANDLE_VALUE;
+    _size = 0;
+}
+
+bool DraftHistoryReader::Open(const std::wstring& directory) {
+    std::filesystem::path path = directory;
+    _roomNames = ReadRoomDictionary(path / L"rooms.dict");
+    MappedColumn* columns[] = {&_timestamp, &_slot, &_forced, &_drawn, &_deckEnd};
+    static_assert(std::size(columns) == std::size(s_eventColumns));
+
+    _size = SIZE_MAX;
+    for (size_t i = 0; i < std::size(columns); i++) {
+        if (!columns[i]->Open(path / s_eventColumns[i].first)) return false;
+        _size = std::min(_size, columns[i]->Size<byte>() / s_eventColumns[i].second);
+    }
+    if (!_deckRooms.Open(path / L"deckRooms.col")) return false;
+
+    // Only count the events whose decks were completely written.
+    while (_size > 0 && _deckEnd.Data<uint32_t>()[_size - 1] > _deckRooms.Size<uint16_t>()) _size--;
+    return true;
+}
+
+std::pair<const uint16_t*, size_t> DraftHistoryReader::Deck(size_t event) const {
+    const uint32_t* deckEnds = _deckEnd.Data<uint32_t>();
+    uint32_t start = (event == 0) ? 0 : deckEnds[event - 1];
+    return {_deckRooms.Data<uint16_t>() + start, deckEnds[event] - start};
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+
+// An append-only, columnar history of draft events. Each store is a directory with one file per column, and every column is a flat array
+// of fixed-width (little endian) values, so that a reader can map the files and index them directly, without any parsing.
+// Rooms are dictionary-encoded: rooms.dict lists the room names (UTF-16, one per line), and room ID i is line i - 1. Room ID 0 means 'no room'.
+//   timestamp.col  int64   Seconds since the Unix epoch
+//   slot.col       uint8   Draft slot, from 0 to 2
+//   forced.col     uint16  Room ID of the forced override for this slot (0 if none)
+//   drawn.col      uint16  Room ID of the room which was drawn into this slot
+//   deckEnd.col    uint32  End of this event's offered deck in deckRooms.col (each deck starts at the previous event's end)
+//   deckRooms.col  uint16  Room IDs of every offered deck, back to back
+// The number of events is the length of the shortest event column, so a store which was interrupted mid-flush is still consistent.
+class DraftHistoryWriter final {
+public:
+    bool Open(const std::wstring& directory); // Creates the store, or appends to it if it already exists.
+    bool IsOpen() const { return !_directory.empty(); }
+    uint16_t GetRoomId(std::wstring_view name); // Adds new rooms to the dictionary. Empty names are room 0.
+    void Append(int64_t timestamp, uint8_t slot, uint16_t forced, uint16_t drawn, const std::vector<uint16_t>& deck);
+    void Flush(); // Events are buffered until the next flush.
+    void Close();
+
+private:
+    template <class T>
+    void AppendColumn(const wchar_t* name, std::vector<T>& values);
+
+    std::filesystem::path _directory;
+    std::map<std::wstring, uint16_t, std::less<>> _roomIds;
+    std::vector<std::wstring> _newRooms;
+    uint32_t _deckEnd = 0;
+
+    std::vector<int64_t> _timestamps;
+    std::vector<uint8_t> _slots;
+    std::vector<uint16_t> _forced;
+    std::vector<uint16_t> _drawn;
+    std::vector<uint32_t> _deckEnds;
+    std::vector<uint16_t> _deckRooms;
+};
+
+// A read-only file mapping of one column.
+class MappedColumn final {
+public:
+    MappedColumn() = default;
+    ~MappedColumn() { Close(); }
+    MappedColumn(const MappedColumn& other) = delete;
+    MappedColumn& operator=(const MappedColumn& other) = delete;
+
+    bool Open(const std::filesystem::path& path); // A missing or empty file is an empty column.
+    void Close();
+    template <class T>
+    const T* Data() const { return static_cast<const T*>(_view); }
+    template <class T>
+    size_t Size() const { return _size / sizeof(T); }
+
+private:
+    HANDLE _file = INVALID_HANDLE_VALUE;
+    HANDLE _mapping = nullptr;
+    const void* _view = nullptr;
+    size_t _size = 0;
+};
+
+class DraftHistoryReader final {
+public:
+    bool Open(const std::wstring& directory);
+    size_t Size() const { return _size; }
+
+    const int64_t* Timestamps() const { return _timestamp.Data<int64_t>(); }
+    const uint8_t* Slots() const { return _slot.Data<uint8_t>(); }
+    const uint16_t* Forced() const { return _forced.Data<uint16_t>(); }
+    const uint16_t* Drawn() const { return _drawn.Data<uint16_t>(); }
+    std::pair<const uint16_t*, size_t> Deck(size_t event) const; // [first room ID, number of rooms]
+
+    size_t NumRoomIds() const { return _roomNames.size() + 1; } // Including room 0
+    std::wstring_view RoomName(uint16_t roomId) const { return (roomId == 0 || roomId > _roomNames.size()) ? std::wstring_view() : _roomNames[roomId - 1]; }
+
+private:
+    MappedColumn _timestamp;
+    MappedColumn _slot;
+    MappedColumn _forced;
+    MappedColumn _drawn;
+    MappedColumn _deckEnd;
+    MappedColumn _deckRooms;
+    size_t _size = 0;
+    std::vector<std::wstring> _roomNames;
+};
@@ -0,0 +1,150 @@
+#include "pch.h"
+#include "DraftStats.h"
+#include "DraftHistory.h"
+#include <atomic>
+
+DraftStats::DraftStats() : _counts(std::make_unique<Counts>()) {
+    *_counts = {};
+}
+
+DraftStats::DraftStats(const DraftStats& other) : _counts(std::make_unique<Counts>()) {
+    *this = other;
+}
+
+DraftStats& DraftStats::operator=(const DraftStats& other) {
+    if (this == &other) return *this;
+    *_counts = *other._counts;
+    _roomNames = other._roomNames;
+    _roomIds = other._roomIds;
+    _lastSlot = other._lastSlot;
+    _roundDrawn = other._roundDrawn;
+    _currentStreak = other._currentStreak;
+    _lastRoundDrawn = other._lastRoundDrawn;
+    _round = other._round;
+    return *this;
+}
+
+uint16_t DraftStats::Intern(std::wstring_view name) {
+    if (name.empty()) return 0;
+    auto search = _roomIds.find(name);
+    if (search != _roomIds.end()) return search->second;
+    if (_roomNames.size() + 1 >= s_maxRooms) return 0;
+
+    _roomNames.emplace_back(name);
+    uint16_t roomId = static_cast<uint16_t>(_roomNames.size());
+    _roomIds.emplace(_roomNames.back(), roomId);
+    return roomId;
+}
+
+void DraftStats::AddDraft(uint8_t slot, const uint16_t* deck, size_t deckSize, uint16_t forced, uint16_t drawn) {
+    if (slot >= s_numSlots) return;
+    if (static_cast<int>(slot) <= _lastSlot) FinishRound();
+    _lastSlot = slot;
+
+    Counts& counts = *_counts;
+    counts.decks[slot]++;
+    for (size_t i = 0; i < deckSize; i++) {
+        if (deck[i] < s_maxRooms) counts.offered[slot][deck[i]]++;
+    }
+    if (forced < s_maxRooms) counts.forced[slot][forced]++;
+    if (drawn == 0 || drawn >= s_maxRooms) return;
+    counts.drawn[slot][drawn]++;
+    _roundDrawn[slot] = drawn;
+
+    // _lastRoundDrawn is 1 + the round, so that 0 means 'never'.
+    if (_lastRoundDrawn[drawn] == _round + 1) return; // Already drawn in another slot this round
+    _currentStreak[drawn] = (_lastRoundDrawn[drawn] == _round) ? _currentStreak[drawn] + 1 : 1;
+    _lastRoundDrawn[drawn] = _round + 1;
+    counts.longestStreak[drawn] = std::max(counts.longestStreak[drawn], _currentStreak[drawn]);
+}
+
+void DraftStats::FinishRound() {
+    for (size_t i = 0; i < s_numSlots; i++) {
+        for (size_t j = i + 1; j < s_numSlots; j++) {
+            uint16_t a = _roundDrawn[i];
+            uint16_t b = _roundDrawn[j];
+            if (a == 0 || b == 0) continue;
+            _counts->drawnTogether[a][b]++;
+            if (a != b) _counts->drawnTogether[b][a]++;
+        }
+    }
+    _roundDrawn = {};
+    _lastSlot = -1;
+    _round++;
+}
+
+void DraftStats::Merge(const DraftStats& other) {
+    std::vector<uint16_t> remap(other.NumRoomIds(), 0);
+    for (size_t i = 1; i < remap.size(); i++) remap[i] = Intern(other.RoomName(static_cast<uint16_t>(i)));
+
+    Counts& counts = *_counts;
+    const Counts& otherCounts = *other._counts;
+    for (size_t slot = 0; slot < s_numSlots; slot++) {
+        counts.decks[slot] += otherCounts.decks[slot];
+        for (size_t i = 0; i < remap.size(); i++) {
+            counts.offered[slot][remap[i]] += otherCounts.offered[slot][i];
+            counts.drawn[slot][remap[i]] += otherCounts.drawn[slot][i];
+            counts.forced[slot][remap[i]] += otherCounts.forced[slot][i];
+        }
+    }
+    for (size_t i = 1; i < remap.size(); i++) {
+        counts.longestStreak[remap[i]] = std::max(counts.longestStreak[remap[i]], otherCounts.longestStreak[i]);
+        for (size_t j = 1; j < remap.size(); j++) counts.drawnTogether[remap[i]][remap[j]] += otherCounts.drawnTogether[i][j];
+    }
+}
+
+double DraftStats::OfferedRate(uint8_t slot, uint16_t roomId) const {
+    if (slot >= s_numSlots || roomId >= s_maxRooms || _counts->decks[slot] == 0) return 0.0;
+    return static_cast<double>(_counts->offered[slot][roomId]) / _counts->decks[slot];
+}
+
+double DraftStats::DrawRate(uint16_t roomId) const {
+    if (roomId >= s_maxRooms) return 0.0;
+    uint64_t total = 0;
+    uint64_t room = 0;
+    for (size_t slot = 0; slot < s_numSlots; slot++) {
+        for (uint32_t count : _counts->drawn[slot]) total += count;
+        room += _counts->drawn[slot][roomId];
+    }
+    return (total == 0) ? 0.0 : static_cast<double>(room) / total;
+}
+
+DraftStats DraftStats::Replay(const std::vector<std::wstring>& directories, unsigned threads) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<unsigned>(threads, static_cast<unsigned>(std::max<size_t>(1, directories.size())));
+
+    // Each thread claims whole stores, and accumulates them into its own stats.
+    std::atomic<size_t> nextStore = 0;
+    std::vector<DraftStats> threadStats(threads);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            SetCurrentThreadName(L"Draft Replay");
+            DraftStats& stats = threadStats[t];
+            std::vector<uint16_t> remap;
+            std::vector<uint16_t> deck;
+            for (size_t store = nextStore++; store < directories.size(); store = nextStore++) {
+                DraftHistoryReader reader;
+                if (!reader.Open(directories[store])) continue;
+                remap.assign(reader.NumRoomIds(), 0);
+                for (size_t i = 1; i < remap.size(); i++) remap[i] = stats.Intern(reader.RoomName(static_cast<uint16_t>(i)));
+                auto lookup = [&remap](uint16_t roomId) { return roomId < remap.size() ? remap[roomId] : uint16_t(0); };
+
+                for (size_t event = 0; event < reader.Size(); event++) {
+                    auto [rooms, size] = reader.Deck(event);
+                    deck.resize(size);
+                    for (size_t i = 0; i < size; i++) deck[i] = lookup(rooms[i]);
+                    stats.AddDraft(reader.Slots()[event], deck.data(), deck.size(), lookup(reader.Forced()[event]), lookup(reader.Drawn()[event]));
+                }
+                // Each store is a separate run, so neither rounds nor streaks continue into the next one.
+                stats.FinishRound();
+                stats._round++;
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+
+    DraftStats result = threadStats[0];
+    for (unsigned t = 1; t < threads; t++) result.Merge(threadStats[t]);
+    return result;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <array>
+#include <memory>
+#include <string_view>
+
+// Running draft statistics, which are updated as each draft event arrives (either live, or replayed from a DraftHistory store).
+// Rooms have their own IDs here (so that stores with different dictionaries can be combined), and every aggregate is a fixed-size array
+// indexed by room ID. Each event costs O(deck size); the co-occurrence counts only cover the rooms drawn together in one round (one per slot).
+class DraftStats final {
+public:
+    static constexpr size_t s_maxRooms = 0x100; // Room 0 means 'no room'. Any rooms past this are ignored.
+    static constexpr size_t s_numSlots = 3;
+
+    struct Counts {
+        std::array<uint32_t, s_numSlots> decks; // Number of decks offered in each slot
+        std::array<std::array<uint32_t, s_maxRooms>, s_numSlots> offered; // Times each room was in a slot's deck (counting duplicates)
+        std::array<std::array<uint32_t, s_maxRooms>, s_numSlots> drawn; // Times each room was drawn into a slot
+        std::array<std::array<uint32_t, s_maxRooms>, s_numSlots> forced; // Times each room was forced into a slot
+        std::array<uint32_t, s_maxRooms> longestStreak; // Most consecutive rounds in which the room was drawn (in any slot)
+        std::array<std::array<uint32_t, s_maxRooms>, s_maxRooms> drawnTogether; // Symmetric. Times two rooms were drawn in the same round
+    };
+
+    DraftStats();
+    DraftStats(const DraftStats& other);
+    DraftStats& operator=(const DraftStats& other);
+
+    uint16_t Intern(std::wstring_view name); // Returns 0 for empty names (or if there are too many rooms)
+    std::wstring_view RoomName(uint16_t roomId) const { return (roomId == 0 || roomId > _roomNames.size()) ? std::wstring_view() : _roomNames[roomId - 1]; }
+    size_t NumRoomIds() const { return _roomNames.size() + 1; }
+
+    // Events are expected in draft order. A slot which is not after the previous event's slot starts a new round.
+    void AddDraft(uint8_t slot, const uint16_t* deck, size_t deckSize, uint16_t forced, uint16_t drawn);
+    void Merge(const DraftStats& other); // Streaks are not continued across the two.
+
+    const Counts& GetCounts() const { return *_counts; }
+    uint32_t CurrentStreak(uint16_t roomId) const { return _currentStreak[roomId]; }
+    double OfferedRate(uint8_t slot, uint16_t roomId) const; // Fraction of this slot's decks which contained the room
+    double DrawRate(uint16_t roomId) const; // Fraction of all draws (across every slot) which were this room. This is the room's empirical rarity.
+
+    // Replays DraftHistory stores in parallel (one store per task), and merges the results. threads = 0 uses every core.
+    static DraftStats Replay(const std::vector<std::wstring>& directories, unsigned threads = 0);
+
+private:
+    void FinishRound();
+
+    std::unique_ptr<Counts> _counts;
+    std::vector<std::wstring> _roomNames;
+    std::map<std::wstring, uint16_t, std::less<>> _roomIds;
+
+    // The round in progress
+    int _lastSlot = -1;
+    std::array<uint16_t, s_numSlots> _roundDrawn = {};
+    std::array<uint32_t, s_maxRooms> _currentStreak = {};
+    std::array<uint32_t, s_maxRooms> _lastRoundDrawn = {}; // 1 + the last round in which each room was drawn
+    uint32_t _round = 0;
+};
@@ -2,11 +2,18 @@
 #include "Memory.h"
 #include <psapi.h>
 #include <tlhelp32.h>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
 
 Memory::~Memory() {
+    StopRpcWorker(false);
     if (_handle != nullptr) {
         CloseHandle(_handle);
     }
+    if (_launchingHandle != nullptr) {
+        CloseHandle(_launchingHandle);
+    }
 }
 
 void Memory::BringToFront() {
@@ -40,42 +47,86 @@ HWND Memory::GetProcessHwnd(DWORD pid) {
 }
 
 ProcStatus Memory::TryAttachToProcess() {
-    // First, get the handle of the process. Note that we might attach before the main HWND is opened,
-    // in which case we will save the 'attachment' and only retry for the HWND.
+    // First, find the process. This is the only step which needs a process snapshot; once we have a handle,
+    // we only need to poll its module list until the game module is loaded (and then its HWND, which may open later still).
     if (_handle == nullptr) {
-        HANDLE handle = nullptr;
-        PROCESSENTRY32W entry;
-        entry.dwSize = sizeof(entry);
-        HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
-        while (Process32NextW(snapshot, &entry)) {
-            if (_processName == entry.szExeFile) {
+        if (_launchingHandle == nullptr) {
+            PROCESSENTRY32W entry;
+            entry.dwSize = sizeof(entry);
+            HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+            if (snapshot == INVALID_HANDLE_VALUE) return ProcStatus::NotRunning;
+            for (BOOL found = Process32FirstW(snapshot, &entry); found; found = Process32NextW(snapshot, &entry)) {
+                if (_processName != entry.szExeFile) continue;
+                HANDLE handle = OpenProcess(PROCESS_ALL_ACCESS, FALSE, entry.th32ProcessID);
+                if (!handle) continue;
+                // A process which has exited can still be listed for a moment, so make sure we don't attach to it again.
+                if (WaitForSingleObject(handle, 0) != WAIT_TIMEOUT) {
+                    CloseHandle(handle);
+                    continue;
+                }
                 _pid = entry.th32ProcessID;
-                handle = OpenProcess(PROCESS_ALL_ACCESS, FALSE, _pid);
+                _launchingHandle = handle;
                 break;
             }
+            CloseHandle(snapshot);
+            if (_launchingHandle == nullptr) return ProcStatus::NotRunning;
+        }
+
+        if (WaitForSingleObject(_launchingHandle, 0) != WAIT_TIMEOUT) {
+            // The process exited before it finished loading.
+            CloseHandle(_launchingHandle);
+            _launchingHandle = nullptr;
+            _pid = 0;
+            return ProcStatus::NotRunning;
         }
-        if (!handle) return ProcStatus::NotRunning;
 
-        std::tie(_baseAddress, _endOfModule) = DebugUtils::GetModuleBounds(handle, _moduleName);
+        std::tie(_baseAddress, _endOfModule) = DebugUtils::GetModuleBounds(_launchingHandle, _moduleName);
         if (_baseAddress == 0) return ProcStatus::NotRunning;
 
         BOOL wow64Process = false;
-        IsWow64Process(handle, &wow64Process);
+        IsWow64Process(_launchingHandle, &wow64Process);
         _pointerSize = (wow64Process == TRUE) ? 4 : 8;
-        _handle = handle; // Save the handle to indicate that we've correctly attached.
+        _handle = _launchingHandle; // Save the handle to indicate that we've correctly attached.
+        _launchingHandle = nullptr;
+        std::atomic_store(&_processToken, std::make_shared<CancellationToken>());
     }
 
-    DWORD exitCode = 0;
-    GetExitCodeProcess(_handle, &exitCode);
-    if (exitCode != STILL_ACTIVE) {
+    // The process handle is signaled when the process exits. (Unlike GetExitCodeProcess, this can't be fooled by an exit code of STILL_ACTIVE.)
+    if (WaitForSingleObject(_handle, 0) != WAIT_TIMEOUT) {
         // Process has exited, clean up.
-        _handle = nullptr;
+        _processToken->Cancel();
+        StopRpcWorker(true);
+        {
+            // A failed start says nothing about the next process.
+            std::lock_guard<std::mutex> l(_rpcMutex);
+            _rpcBackoff = s_rpcMinBackoff;
+            _rpcNextStart = {};
+        }
+        _patchHelpers = 0;
+        {
+            // None of our edits (or allocations) survive the process.
+            std::lock_guard<std::mutex> l(_journalMutex);
+            _journal.clear();
+            _featureEnabled.clear();
+            _journalValues.clear();
+            _featureAllocations.clear();
+        }
+        {
+            std::unique_lock<std::shared_mutex> l(_handleMutex);
+            CloseHandle(_handle);
+            _handle = nullptr;
+        }
         _pid = 0;
         _hwnd = nullptr;
         _computedAddresses.Clear();
 
-        // Reset the 'found' state on all sigscans, as they will (often) move when the game reloads.
-        for (auto& sigScan : _sigScans) sigScan.found = false;
+        // Process sigscans are done. Session sigscans are run again for the next process, as the code will (often) move when the game reloads.
+        std::lock_guard<std::mutex> l(_sigScanMutex);
+        _sigScans.erase(std::remove_if(_sigScans.begin(), _sigScans.end(), [](const SigScan& sigScan) { return sigScan.scope == SigScanScope::Process; }), _sigScans.end());
+        for (auto& sigScan : _sigScans) {
+            sigScan.found = false;
+            sigScan.result->addresses.clear();
+        }
 
         return ProcStatus::Stopped;
     }
@@ -86,42 +137,82 @@ ProcStatus Memory::TryAttachToProcess() {
     return ProcStatus::Running;
 }
 
+void Memory::WaitForProcessEvent(std::chrono::milliseconds timeout, HANDLE cancelEvent) {
+    HANDLE handles[2] = {cancelEvent, _handle != nullptr ? _handle.load() : _launchingHandle};
+    DWORD numHandles = (handles[1] != nullptr) ? 2 : 1;
+    WaitForMultipleObjects(numHandles, handles, FALSE, static_cast<DWORD>(timeout.count()));
+}
+
 __int64 Memory::ReadStaticInt(__int64 offset, int index, const std::vector<byte>& data, size_t bytesToEOL) {
     // (address of next line) + (index interpreted as 4byte int)
     return offset + index + bytesToEOL + *(int*)&data[index];
 }
 
-// Small wrapper for non-failing scan functions
-void Memory::AddSigScan(const std::string& scanHex, const ScanFunc& scanFunc) {
-    _sigScans.emplace_back(SigScan{false, scanHex, SigScan::GetScanBytes(scanHex), [scanFunc](__int64 offset, int index, const std::vector<byte>& data) {
-        scanFunc(offset, index, data);
-        return true;
-        }});
+Memory::SigScanHandle Memory::AddSigScan(const Signature& signature, SigScanScope scope, const ScanFunc& scanFunc) {
+    SigScan sigScan{0, scope, false, false, {signature.Bytes(), signature.Bytes() + signature.Size()}, {}, scanFunc};
+    if (std::any_of(signature.Mask(), signature.Mask() + signature.Size(), [](byte b) { return b != 0xFF; })) {
+        sigScan.mask.assign(signature.Mask(), signature.Mask() + signature.Size());
+    }
+    return AddSigScanInternal(std::move(sigScan));
 }
 
-void Memory::AddSigScan2(const std::string& scanHex, const ScanFunc2& scanFunc) {
-    _sigScans.emplace_back(SigScan{false, scanHex, SigScan::GetScanBytes(scanHex), scanFunc});
+Memory::SigScanHandle Memory::AddSigScanAll(const std::vector<byte>& bytes, SigScanScope scope) {
+    assert(!bytes.empty() && bytes.size() <= SCAN_OVERLAP, "[INTERNAL ERROR] Pattern is longer than the chunk overlap");
+    return AddSigScanInternal(SigScan{0, scope, false, true, bytes});
 }
 
-std::vector<byte> Memory::SigScan::GetScanBytes(const std::string& scanHex) {
-    std::vector<byte> bytes;
-    byte b = 0x00;
-    bool halfByte = false;
-    for (char ch : scanHex) {
-        if (ch == ' ') continue;
+Memory::SigScanHandle Memory::AddSigScanInternal(SigScan&& sigScan) {
+    SigScanHandle handle;
+    handle._memory = this;
+    handle._result = std::make_shared<SigScanHandle::Result>();
+    sigScan.result = handle._result;
 
-        static std::string HEX_CHARS = "0123456789ABCDEF";
-        b *= 16;
-        b += (byte)HEX_CHARS.find(ch);
-        if (halfByte) bytes.push_back(b);
-        halfByte = !halfByte;
-    }
-    assert(!halfByte, "[INTERNAL ERROR] Could not parse hex bytes");
+    std::lock_guard<std::mutex> l(_sigScanMutex);
+    handle._id = sigScan.id = _nextSigScanId++;
+    _sigScans.emplace_back(std::move(sigScan));
+    return handle;
+}
+
+void Memory::RemoveSigScan(uint64_t id) {
+    std::lock_guard<std::mutex> l(_sigScanMutex);
+    _sigScans.erase(std::remove_if(_sigScans.begin(), _sigScans.end(), [id](const SigScan& sigScan) { return sigScan.id == id; }), _sigScans.end());
+}
 
-    return bytes;
+Memory::SigScanHandle& Memory::SigScanHandle::operator=(SigScanHandle&& other) noexcept {
+    if (this == &other) return *this;
+    Reset();
+    _memory = std::exchange(other._memory, nullptr);
+    _id = std::exchange(other._id, 0);
+    _result = std::move(other._result);
+    return *this;
 }
 
-int find(const std::vector<byte>& data, const std::vector<byte>& search) {
+void Memory::SigScanHandle::Reset() {
+    if (_memory != nullptr) _memory->RemoveSigScan(_id);
+    _memory = nullptr;
+    _id = 0;
+    _result = nullptr;
+}
+
+const std::vector<uintptr_t>& Memory::SigScanHandle::Addresses() const {
+    static const std::vector<uintptr_t> s_noAddresses;
+    return (_result != nullptr) ? _result->addresses : s_noAddresses;
+}
+
+std::string Memory::SigScan::ToString() const {
+    std::stringstream ss;
+    ss << std::hex << std::uppercase << std::setfill('0');
+    for (size_t i = 0; i < bytes.size(); i++) {
+        if (i > 0) ss << ' ';
+        if (!mask.empty() && mask[i] == 0x00) ss << "??";
+        else ss << std::setw(2) << static_cast<int>(bytes[i]);
+    }
+    return ss.str();
+}
+
+// An empty mask means that every byte must match.
+int find(const std::vector<byte>& data, const std::vector<byte>& search, const std::vector<byte>& mask) {
+    if (data.size() < search.size()) return -1;
     const byte* dataBegin = &data[0];
     const byte* searchBegin = &search[0];
     size_t maxI = data.size() - search.size();
@@ -130,7 +221,8 @@ int find(const std::vector<byte>& data, const std::vector<byte>& search) {
     for (int i=0; i<maxI; i++) {
         bool match = true;
         for (size_t j=0; j<maxJ; j++) {
-            if (*(dataBegin + i + j) == *(searchBegin + j)) {
+            byte m = mask.empty() ? 0xFF : mask[j];
+            if (((*(dataBegin + i + j) ^ *(searchBegin + j)) & m) == 0) {
                 continue;
             }
             match = false;
@@ -141,33 +233,146 @@ int find(const std::vector<byte>& data, const std::vector<byte>& search) {
     return -1;
 }
 
-#define BUFFER_SIZE 0x10000 // 10 KB
+// Puts the original bytes of each edit back into data, which was read from address.
+void UndoEdits(const std::vector<std::pair<uintptr_t, std::vector<byte>>>& originals, uintptr_t address, std::vector<byte>& data) {
+    // Later edits may overwrite earlier ones, so the earliest original bytes are the ones which go in last.
+    for (auto it = originals.rbegin(); it != originals.rend(); ++it) {
+        uintptr_t begin = std::max(it->first, address);
+        uintptr_t end = std::min(it->first + it->second.size(), address + data.size());
+        if (begin >= end) continue;
+        std::copy(it->second.begin() + (begin - it->first), it->second.begin() + (end - it->first), data.begin() + (begin - address));
+    }
+}
+
+void Memory::ScanModule(const ChunkFunc& onChunk) {
+    struct Buffer {
+        uintptr_t address = 0;
+        size_t chunkSize = 0;
+        std::vector<byte> data;
+    };
+    std::array<Buffer, SCAN_BUFFERS> buffers;
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t numRead = 0;
+    size_t numConsumed = 0;
+    bool readerDone = false;
+    bool stop = false;
+
+    std::vector<std::pair<uintptr_t, std::vector<byte>>> originals; // [address, original bytes] of each journaled edit
+    {
+        std::lock_guard<std::mutex> l(_journalMutex);
+        for (const auto& entry : _journal) originals.emplace_back(entry.address, entry.originalBytes);
+    }
+
+    std::thread reader([&] {
+        SetCurrentThreadName(L"Sigscan Reader");
+        MEMORY_BASIC_INFORMATION info;
+        for (uintptr_t region = _baseAddress; region < _endOfModule;) {
+            {
+                std::shared_lock<std::shared_mutex> l(_handleMutex);
+                if (!VirtualQueryEx(_handle, reinterpret_cast<void*>(region), &info, sizeof(info))) break;
+            }
+            uintptr_t regionEnd = std::min(reinterpret_cast<uintptr_t>(info.BaseAddress) + info.RegionSize, _endOfModule);
+            bool readable = info.State == MEM_COMMIT && !(info.Protect & (PAGE_NOACCESS | PAGE_GUARD));
+            if (!readable) {
+                region = regionEnd;
+                continue;
+            }
+
+            // Big regions (i.e. the code) are read in big chunks, so that there are fewer calls, but at least a few of them per region,
+            // so that the reads and matches can overlap. Sections are separate regions, so matches never need to cross one.
+            size_t chunkSize = std::clamp<size_t>((regionEnd - region) / (SCAN_BUFFERS + 1), SCAN_MIN_CHUNK, SCAN_MAX_CHUNK);
+            for (uintptr_t address = region; address < regionEnd; address += chunkSize) {
+                {
+                    std::unique_lock<std::mutex> l(mutex);
+                    cv.wait(l, [&] { return stop || numRead - numConsumed < SCAN_BUFFERS; });
+                    if (stop) return;
+                }
+                Buffer& buffer = buffers[numRead % SCAN_BUFFERS];
+                buffer.address = address;
+                buffer.chunkSize = std::min<size_t>(chunkSize, regionEnd - address);
+                buffer.data.resize(std::min<size_t>(chunkSize + SCAN_OVERLAP, regionEnd - address));
+                SIZE_T numBytesRead = 0;
+                {
+                    std::shared_lock<std::shared_mutex> l(_handleMutex);
+                    if (!ReadProcessMemory(_handle, reinterpret_cast<void*>(address), buffer.data.data(), buffer.data.size(), &numBytesRead)) continue;
+                }
+                buffer.data.resize(numBytesRead);
+                UndoEdits(originals, address, buffer.data);
+                {
+                    std::lock_guard<std::mutex> l(mutex);
+                    numRead++;
+                }
+                cv.notify_all();
+            }
+            region = regionEnd;
+        }
+        {
+            std::lock_guard<std::mutex> l(mutex);
+            readerDone = true;
+        }
+        cv.notify_all();
+    });
+
+    for (size_t chunk = 0;; chunk++) {
+        {
+            std::unique_lock<std::mutex> l(mutex);
+            cv.wait(l, [&] { return readerDone || numRead > chunk; });
+            if (numRead <= chunk) break; // The reader is done, and every chunk has been consumed
+        }
+        const Buffer& buffer = buffers[chunk % SCAN_BUFFERS];
+        bool keepGoing = onChunk(buffer.address, buffer.chunkSize, buffer.data);
+        {
+            std::lock_guard<std::mutex> l(mutex);
+            numConsumed++;
+            stop = !keepGoing;
+        }
+        cv.notify_all();
+        if (!keepGoing) break;
+    }
+    reader.join();
+}
+
 size_t Memory::ExecuteSigScans() {
+    std::lock_guard<std::mutex> l(_sigScanMutex);
     size_t notFound = 0;
-    for (const auto& sigScan : _sigScans) if (!sigScan.found) notFound++;
-    if (notFound == 0) return 0; // Early exit in case we've already found all our scans
-    std::vector<byte> buff;
-    buff.resize(BUFFER_SIZE + 0x100); // padding in case the sigscan is past the end of the buffer
-
-    for (uintptr_t i = _baseAddress; i < _endOfModule; i += BUFFER_SIZE) {
-        SIZE_T numBytesWritten;
-        if (!ReadProcessMemory(_handle, reinterpret_cast<void*>(i), &buff[0], buff.size(), &numBytesWritten)) continue;
-        buff.resize(numBytesWritten);
+    size_t findAll = 0; // These need the whole module, so they prevent the early exit
+    for (const auto& sigScan : _sigScans) {
+        if (sigScan.found) continue;
+        if (sigScan.findAll) findAll++;
+        else notFound++;
+    }
+    if (notFound == 0 && findAll == 0) return 0; // Early exit in case we've already found all our scans
+
+    ScanModule([&](uintptr_t address, size_t chunkSize, const std::vector<byte>& data) {
         for (auto& sigScan : _sigScans) {
             if (sigScan.found) continue;
-            int index = find(buff, sigScan.bytes);
+            if (sigScan.findAll) {
+                // Matches may run into the overlap, but must start inside this chunk (otherwise the next chunk reports them too).
+                auto chunkEnd = data.begin() + std::min(chunkSize, data.size());
+                for (auto it = data.begin(); (it = std::search(it, data.end(), sigScan.bytes.begin(), sigScan.bytes.end())) < chunkEnd; ++it) {
+                    sigScan.result->addresses.push_back(address + (it - data.begin()));
+                }
+                continue;
+            }
+            int index = find(data, sigScan.bytes, sigScan.mask);
             if (index == -1) continue;
-            sigScan.found = sigScan.scanFunc(i, index, buff);
-            if (sigScan.found) notFound--;
+            sigScan.result->addresses.push_back(address + index);
+            if (sigScan.scanFunc) sigScan.scanFunc(address, index, data);
+            sigScan.found = true;
+            notFound--;
         }
-        if (notFound == 0) break;
+        return notFound > 0 || findAll > 0;
+    });
+    for (auto& sigScan : _sigScans) {
+        if (sigScan.findAll) sigScan.found = true;
     }
 
     if (notFound > 0) {
         DebugPrint("Failed to find " + std::to_string(notFound) + " sigscans:");
         for (const auto& sigScan : _sigScans) {
             if (sigScan.found) continue;
-            DebugPrint(sigScan.hex);
+            DebugPrint(sigScan.ToString());
         }
     } else {
         DebugPrint("Found all sigscans!");
@@ -176,6 +381,26 @@ size_t Memory::ExecuteSigScans() {
     return notFound;
 }
 
+std::map<uintptr_t, std::vector<uintptr_t>> Memory::FindRipRelativeReferences(const std::vector<byte>& opcode, const std::vector<uintptr_t>& targets) {
+    std::map<uintptr_t, std::vector<uintptr_t>> references;
+    for (uintptr_t target : targets) references[target]; // So that targets without references are still listed
+    size_t instructionSize = opcode.size() + 4;
+
+    ScanModule([&](uintptr_t address, size_t chunkSize, const std::vector<byte>& data) {
+        if (data.size() < instructionSize) return true;
+        size_t maxJ = std::min<size_t>(chunkSize, data.size() - instructionSize + 1);
+        for (size_t j = 0; j < maxJ; j++) {
+            if (!std::equal(opcode.begin(), opcode.end(), data.begin() + j)) continue;
+            // (address of next instruction) + disp32, as in ReadStaticInt
+            uintptr_t target = address + j + instructionSize + *reinterpret_cast<const int*>(&data[j + opcode.size()]);
+            auto search = references.find(target);
+            if (search != references.end()) search->second.push_back(address + j);
+        }
+        return true;
+    });
+    return references;
+}
+
 // Technically this is ReadChar*, but this name makes more sense with the return type.
 std::string Memory::ReadString(const std::vector<__int64>& offsets) {
     __int64 charAddr = ReadData<__int64>(offsets, 1)[0];
@@ -192,88 +417,294 @@ std::string Memory::ReadString(const std::vector<__int64>& offsets) {
     return std::string(tmp.begin(), nullTerminator);
 }
 
-int32_t Memory::CallFunction(int64_t address,
-    const int64_t rcx, const int64_t rdx, const int64_t r8, const int64_t r9,
-    const float xmm0, const float xmm1, const float xmm2, const float xmm3) {
-    struct Arguments {
-        uintptr_t address;
-        int64_t rcx;
-        int64_t rdx;
-        int64_t r8;
-        int64_t r9;
-        float xmm0;
-        float xmm1;
-        float xmm2;
-        float xmm3;
-    };
-    Arguments args = {
-        ComputeOffset({address}),
-        rcx, rdx, r8, r9,
-        xmm0, xmm1, xmm2, xmm3,
+std::vector<std::future<__int64>> Memory::CallFunctions(const std::vector<FunctionCall>& calls) {
+    std::vector<std::future<__int64>> results;
+    std::unique_lock<std::mutex> l(_rpcMutex);
+    if (!_rpcActive) StartRpcWorker();
+
+    auto findFreeSlot = [this] {
+        for (int i = 0; i < RPC_SLOTS; i++) if (!_rpcPromises[i]) return i;
+        return -1;
     };
 
-#define INSTRUCTION_SIZE 57
-
-    if (!_functionPrimitive) {
-        // Some C++ macro magic to look up the member offset of a given field.
-        // For example, args.rcx is 8 bits from the start of the struct, so this would result in 0x08.
-#define OFFSET_OF(field) \
-            static_cast<uint8_t>(((uint64_t)&args.##field - (uint64_t)&args.address) & 0x00000000000000FF)
-
-        // This primitive contains both a series of instructions and a buffer for arguments.
-        // This allows us to write the instructions once, and then just write our new arguments
-        // whenever we need to make another call.
-        const uint8_t instructions[] = {
-            0x48, 0xBB,                                 // mov rbx,  0 ; 0 will be replaced by the address of the arguments struct
-            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-            0x48, 0x8B, 0x4B, OFFSET_OF(rcx),           // mov rcx,  args.rcx
-            0x48, 0x8B, 0x53, OFFSET_OF(rdx),           // mov rdx,  args.rdx
-            0x4C, 0x8B, 0x43, OFFSET_OF(r8),            // mov r8,   args.r8
-            0x4C, 0x8B, 0x4B, OFFSET_OF(r9),            // mov r9,   args.r9
-            0xF3, 0x0F, 0x7E, 0x43, OFFSET_OF(xmm0),    // mov xmm0, args.xmm0
-            0xF3, 0x0F, 0x7E, 0x4B, OFFSET_OF(xmm1),    // mov xmm1, args.xmm1
-            0xF3, 0x0F, 0x7E, 0x53, OFFSET_OF(xmm2),    // mov xmm2, args.xmm2
-            0xF3, 0x0F, 0x7E, 0x5B, OFFSET_OF(xmm3),    // mov xmm3, args.xmm3
-            0x48, 0x83, 0xEC, 0x48,                     // sub rsp,48 ; align the stack pointer for movss opcodes
-            0xFF, 0x13,                                 // call [rbx]
-            0x48, 0x83, 0xC4, 0x48,                     // add rsp,48
-            0xC3,                                       // ret
-        };
-        static_assert(sizeof(instructions) == INSTRUCTION_SIZE, "The instruction size is required to be static for argument writing purposes.");
+    for (const auto& call : calls) {
+        int slot = findFreeSlot();
+        while (slot == -1 && _rpcActive) {
+            SetEvent(_rpcRequestEvent); // Make sure the worker is draining the calls we've already queued
+            _rpcSlotFreed.wait(l);
+            slot = findFreeSlot();
+        }
 
-        // Allocate space for the instructions and arguments buffer,
-        _functionPrimitive = AllocateArray(sizeof(instructions) + sizeof(Arguments));
-        // Then update the instructions to load from the arguments buffer (assuming LE),
-        *(uint64_t*)&instructions[2] = (_functionPrimitive + sizeof(instructions));
-        // and finally write the completed instructions into the target process.
-        WriteDataInternal(instructions, _functionPrimitive, sizeof(instructions));
-    }
+        if (!_rpcActive) {
+            // The worker isn't running (or the process went away while we were waiting), so this call can never complete.
+            std::promise<__int64> failed;
+            failed.set_value(0);
+            results.push_back(failed.get_future());
+            continue;
+        }
 
-    // Then, we can write the arguments into the buffer, to be copied by the instructions.
-    WriteDataInternal(&args, _functionPrimitive + INSTRUCTION_SIZE, sizeof(args));
+        RpcSlot args = {
+            ComputeOffset({call.address}),
+            call.rcx, call.rdx, call.r8, call.r9,
+            call.xmm0, call.xmm1, call.xmm2, call.xmm3,
+            0, RpcState::Free,
+        };
+        uintptr_t slotAddr = _rpcBlock + sizeof(RpcHeader) + slot * sizeof(RpcSlot);
+        // Write the arguments first, and only then mark the slot as pending, so the worker can never observe a half-written call.
+        WriteDataInternal(&args, slotAddr, offsetof(RpcSlot, state));
+        RpcState pending = RpcState::Pending;
+        WriteDataInternal(&pending, slotAddr + offsetof(RpcSlot, state), sizeof(pending));
 
-    // Although I don't use it here, argument 5 (lpParameter) can be used to pass a single 8-byte integer to the target process.
-    // Note that you cannot transfer data this way; if you pass a pointer it will point to memory in this process, not the target.
-    HANDLE thread = CreateRemoteThread(_handle, NULL, 0, (LPTHREAD_START_ROUTINE)_functionPrimitive, 0, 0, 0);
-    if (!thread) {
-        assert(thread, "[Internal error] Failed to allocate a thread in the target process");
-        return 0;
+        _rpcPromises[slot].emplace();
+        results.push_back(_rpcPromises[slot]->get_future());
     }
-    DWORD result = WaitForSingleObject(thread, INFINITE);
 
-    // This will be the return value of the called function.
-    int32_t exitCode = 0;
-    static_assert(sizeof(DWORD) == sizeof(exitCode));
-    GetExitCodeThread(thread, reinterpret_cast<LPDWORD>(&exitCode));
-    return exitCode;
+    if (_rpcActive) SetEvent(_rpcRequestEvent);
+    return results;
 }
 
-int32_t Memory::CallFunction(__int64 address, const std::string& str, __int64 rdx) {
+std::future<__int64> Memory::CallFunction(__int64 address, const std::string& str, __int64 rdx) {
     uintptr_t addr = AllocateArray(str.size());
     WriteDataInternal(&str[0], addr, str.size());
     return CallFunction(address, addr, rdx, 0, 0);
 }
 
+// Must be called with _rpcMutex held.
+void Memory::StartRpcWorker() {
+    if (!_handle) return;
+    if (std::chrono::steady_clock::now() < _rpcNextStart) return; // A previous start failed recently
+
+    // Kernel32 is loaded at the same address in every (64 bit) process, so we can look up these functions locally
+    // and call them from inside the target process.
+    HMODULE kernel32 = GetModuleHandleW(L"Kernel32.dll");
+    RpcHeader header = {};
+    header.waitForSingleObject = reinterpret_cast<uint64_t>(GetProcAddress(kernel32, "WaitForSingleObject"));
+    header.setEvent = reinterpret_cast<uint64_t>(GetProcAddress(kernel32, "SetEvent"));
+
+    // Managed code may only run on threads which are attached to the IL2CPP runtime, so the worker attaches itself before serving any calls.
+    header.domainGet = FindModuleExport("il2cpp_domain_get");
+    header.threadAttach = FindModuleExport("il2cpp_thread_attach");
+    header.threadDetach = FindModuleExport("il2cpp_thread_detach");
+    if (header.domainGet == 0 || header.threadAttach == 0 || header.threadDetach == 0) {
+        DebugPrint("The module does not export the IL2CPP thread functions, so remote calls cannot run managed code");
+        header.threadAttach = 0;
+    }
+
+    // Both events are auto-reset, so a wakeup which arrives while the other side is busy is not lost.
+    _rpcRequestEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+    _rpcCompletionEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+    HANDLE remoteRequestEvent = nullptr;
+    HANDLE remoteCompletionEvent = nullptr;
+    {
+        std::shared_lock<std::shared_mutex> l(_handleMutex);
+        DuplicateHandle(GetCurrentProcess(), _rpcRequestEvent, _handle, &remoteRequestEvent, 0, FALSE, DUPLICATE_SAME_ACCESS);
+        DuplicateHandle(GetCurrentProcess(), _rpcCompletionEvent, _handle, &remoteCompletionEvent, 0, FALSE, DUPLICATE_SAME_ACCESS);
+    }
+    header.requestEvent = reinterpret_cast<uint64_t>(remoteRequestEvent);
+    header.completionEvent = reinterpret_cast<uint64_t>(remoteCompletionEvent);
+
+#define HEADER(field) static_cast<byte>(offsetof(RpcHeader, field))
+#define SLOT(field) static_cast<byte>(offsetof(RpcSlot, field))
+    constexpr size_t slotsOffset = sizeof(RpcHeader);
+    constexpr size_t codeOffset = slotsOffset + sizeof(RpcSlot) * RPC_SLOTS;
+    constexpr uint32_t done = static_cast<uint32_t>(RpcState::Done);
+
+    // The thread entry point receives the address of the RpcHeader in rcx.
+    std::vector<byte> workerInstructions = {
+        0x53,                                       // push rbx                         ; Preserve the registers we use across calls
+        0x56,                                       // push rsi                         ;
+        0x57,                                       // push rdi                         ;
+        0x48, 0x83, 0xEC, 0x20,                     // sub rsp, 20                      ; Shadow space for our callees (this also leaves the stack 16-byte aligned)
+        0x48, 0x89, 0xCB,                           // mov rbx, rcx                     ; rbx = RpcHeader
+        IF_NE(0x48, 0x83, 0x7B, HEADER(threadAttach), 0x00), // cmp qword ptr [rbx+threadAttach], 0
+        THEN(                                       // if (threadAttach != 0) {         ;
+          0xFF, 0x53, HEADER(domainGet),            //   call [rbx+domainGet]           ;   rax = il2cpp_domain_get()
+          0x48, 0x89, 0xC1,                         //   mov rcx, rax                   ;
+          0xFF, 0x53, HEADER(threadAttach),         //   call [rbx+threadAttach]        ;   rax = il2cpp_thread_attach(domain)
+          0x48, 0x89, 0x43, HEADER(il2cppThread)    //   mov [rbx+il2cppThread], rax    ;   Keep the thread, to detach it when we quit
+        ),                                          // }                                ;
+    };
+    size_t loopStart = workerInstructions.size();
+    std::vector<byte> loopInstructions = {
+        0x48, 0x8D, 0x73, static_cast<byte>(slotsOffset), // lea rsi, [rbx+slots]      ; rsi = &slots[0]
+        0xBF, INT_TO_BYTES(RPC_SLOTS),              // mov edi, RPC_SLOTS               ; edi = number of slots remaining
+        DO_WHILE_NONZERO(                           // do {                             ;
+          IF_EQ(0x83, 0x7E, SLOT(state), static_cast<byte>(RpcState::Pending)), // cmp dword ptr [rsi+state], Pending
+          THEN(                                     //   if (slot.state == Pending) {   ;
+            0x48, 0x8B, 0x4E, SLOT(rcx),            //     mov rcx, [rsi+rcx]           ;     Load the arguments out of the slot
+            0x48, 0x8B, 0x56, SLOT(rdx),            //     mov rdx, [rsi+rdx]           ;
+            0x4C, 0x8B, 0x46, SLOT(r8),             //     mov r8, [rsi+r8]             ;
+            0x4C, 0x8B, 0x4E, SLOT(r9),             //     mov r9, [rsi+r9]             ;
+            0xF3, 0x0F, 0x7E, 0x46, SLOT(xmm0),     //     mov xmm0, [rsi+xmm0]         ;
+            0xF3, 0x0F, 0x7E, 0x4E, SLOT(xmm1),     //     mov xmm1, [rsi+xmm1]         ;
+            0xF3, 0x0F, 0x7E, 0x56, SLOT(xmm2),     //     mov xmm2, [rsi+xmm2]         ;
+            0xF3, 0x0F, 0x7E, 0x5E, SLOT(xmm3),     //     mov xmm3, [rsi+xmm3]         ;
+            0xFF, 0x56, SLOT(address),              //     call [rsi+address]           ;     rax = the requested function (rsi is nonvolatile, so it survives the call)
+            0x48, 0x89, 0x46, SLOT(result),         //     mov [rsi+result], rax        ;     Save the return value
+            0xC7, 0x46, SLOT(state), INT_TO_BYTES(done),  // mov dword ptr [rsi+state], Done
+            0x48, 0x8B, 0x4B, HEADER(completionEvent), //  mov rcx, [rbx+completionEvent] ;
+            0xFF, 0x53, HEADER(setEvent)            //     call [rbx+setEvent]          ;     SetEvent(completionEvent) to wake the collector
+          ),                                        //   }                              ;
+          0x48, 0x83, 0xC6, static_cast<byte>(sizeof(RpcSlot)), // add rsi, sizeof(RpcSlot) ; Move to the next slot
+          0xFF, 0xCF                                //   dec edi                        ;
+        ),                                          // } while (edi != 0)               ;
+        0x48, 0x8B, 0x4B, HEADER(requestEvent),     // mov rcx, [rbx+requestEvent]      ;
+        0xBA, INT_TO_BYTES(INFINITE),               // mov edx, INFINITE                ;
+        0xFF, 0x53, HEADER(waitForSingleObject),    // call [rbx+waitForSingleObject]   ; Sleep until somebody submits more work
+        0x83, 0x7B, HEADER(quit), 0x00,             // cmp dword ptr [rbx+quit], 0      ;
+        0x0F, 0x84,                                 // je loopStart                     ; Keep serving requests until we're asked to quit
+    };
+    workerInstructions.insert(workerInstructions.end(), loopInstructions.begin(), loopInstructions.end());
+    int32_t jumpBack = static_cast<int32_t>(loopStart - (workerInstructions.size() + 4));
+    workerInstructions.insert(workerInstructions.end(), {INT_TO_BYTES(jumpBack)});
+    workerInstructions.insert(workerInstructions.end(), {
+        IF_NE(0x48, 0x83, 0x7B, HEADER(il2cppThread), 0x00), // cmp qword ptr [rbx+il2cppThread], 0
+        THEN(                                       // if (il2cppThread != 0) {         ;
+          0x48, 0x8B, 0x4B, HEADER(il2cppThread),   //   mov rcx, [rbx+il2cppThread]    ;
+          0xFF, 0x53, HEADER(threadDetach)          //   call [rbx+threadDetach]        ;   il2cpp_thread_detach(thread)
+        ),                                          // }                                ;
+        0x31, 0xC0,                                 // xor eax, eax                     ; Thread exit code
+        0x48, 0x83, 0xC4, 0x20,                     // add rsp, 20                      ;
+        0x5F,                                       // pop rdi                          ;
+        0x5E,                                       // pop rsi                          ;
+        0x5B,                                       // pop rbx                          ;
+        0xC3,                                       // ret                              ;
+    });
+#undef HEADER
+#undef SLOT
+    static_assert(slotsOffset < 0x80, "The slots must be addressable with an 8-bit displacement");
+    static_assert(sizeof(RpcSlot) < 0x80, "Slot size must fit into an 8-bit immediate");
+
+    _rpcBlock = AllocateArray(codeOffset + workerInstructions.size());
+    // The slots are already zeroed (RpcState::Free) by VirtualAllocEx.
+    WriteDataInternal(&header, _rpcBlock, sizeof(header));
+    WriteDataInternal(&workerInstructions[0], _rpcBlock + codeOffset, workerInstructions.size());
+
+    {
+        std::shared_lock<std::shared_mutex> l(_handleMutex);
+        _rpcThread = CreateRemoteThread(_handle, NULL, 0, (LPTHREAD_START_ROUTINE)(_rpcBlock + codeOffset), (LPVOID)_rpcBlock, 0, 0);
+    }
+    if (!_rpcThread) {
+        DebugPrint("Failed to start the RPC worker, retrying in " + std::to_string(_rpcBackoff.count()) + " ms");
+        // Undo everything above, including the duplicated handles (which can only be closed from the target process' side).
+        {
+            std::shared_lock<std::shared_mutex> l(_handleMutex);
+            VirtualFreeEx(_handle, (void*)_rpcBlock, 0, MEM_RELEASE);
+            DuplicateHandle(_handle, remoteRequestEvent, NULL, NULL, 0, FALSE, DUPLICATE_CLOSE_SOURCE);
+            DuplicateHandle(_handle, remoteCompletionEvent, NULL, NULL, 0, FALSE, DUPLICATE_CLOSE_SOURCE);
+        }
+        CloseHandle(_rpcRequestEvent);
+        CloseHandle(_rpcCompletionEvent);
+        _rpcRequestEvent = nullptr;
+        _rpcCompletionEvent = nullptr;
+        _rpcBlock = 0;
+        _rpcNextStart = std::chrono::steady_clock::now() + _rpcBackoff;
+        _rpcBackoff = std::min(_rpcBackoff * 2, s_rpcMaxBackoff);
+        return;
+    }
+
+    _rpcBackoff = s_rpcMinBackoff;
+    _rpcActive = true;
+    _rpcCollector = std::thread([this] { CollectRpcResults(); });
+}
+
+uintptr_t Memory::FindModuleExport(const char* name) {
+    if (_baseAddress == 0) return 0;
+    IMAGE_DOS_HEADER dosHeader;
+    if (ReadAcrossPages(&dosHeader, _baseAddress, sizeof(dosHeader)) != sizeof(dosHeader) || dosHeader.e_magic != IMAGE_DOS_SIGNATURE) return 0;
+    IMAGE_NT_HEADERS64 ntHeaders;
+    if (ReadAcrossPages(&ntHeaders, _baseAddress + dosHeader.e_lfanew, sizeof(ntHeaders)) != sizeof(ntHeaders) || ntHeaders.Signature != IMAGE_NT_SIGNATURE) return 0;
+    const IMAGE_DATA_DIRECTORY& exportDirectory = ntHeaders.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
+    if (exportDirectory.VirtualAddress == 0 || exportDirectory.Size == 0) return 0;
+    IMAGE_EXPORT_DIRECTORY exports;
+    if (ReadAcrossPages(&exports, _baseAddress + exportDirectory.VirtualAddress, sizeof(exports)) != sizeof(exports)) return 0;
+
+    // The name table is sorted, so we only need to read a handful of names.
+    std::vector<DWORD> names(exports.NumberOfNames);
+    if (names.empty() || ReadAcrossPages(&names[0], _baseAddress + exports.AddressOfNames, names.size() * sizeof(DWORD)) != names.size() * sizeof(DWORD)) return 0;
+    const size_t nameSize = strlen(name) + 1;
+    std::vector<char> candidate(nameSize);
+    size_t low = 0;
+    size_t high = names.size();
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        candidate.assign(nameSize, '\0');
+        ReadAcrossPages(&candidate[0], _baseAddress + names[middle], nameSize); // Anything past the end of a shorter name is just compared as extra characters
+        int comparison = strncmp(&candidate[0], name, nameSize);
+        if (comparison < 0) {
+            low = middle + 1;
+        } else if (comparison > 0) {
+            high = middle;
+        } else {
+            WORD ordinal = 0;
+            DWORD function = 0;
+            if (ReadAcrossPages(&ordinal, _baseAddress + exports.AddressOfNameOrdinals + middle * sizeof(WORD), sizeof(ordinal)) != sizeof(ordinal)) return 0;
+            if (ReadAcrossPages(&function, _baseAddress + exports.AddressOfFunctions + ordinal * sizeof(DWORD), sizeof(function)) != sizeof(function)) return 0;
+            return function != 0 ? _baseAddress + function : 0;
+        }
+    }
+    return 0;
+}
+
+void Memory::StopRpcWorker(bool processExited) {
+    {
+        std::lock_guard<std::mutex> l(_rpcMutex);
+        if (!_rpcActive) return;
+        _rpcActive = false;
+
+        if (!processExited) {
+            // Ask the worker to exit, and give it a moment to finish its current call before we free its memory.
+            uint32_t quit = 1;
+            WriteDataInternal(&quit, _rpcBlock + offsetof(RpcHeader, quit), sizeof(quit));
+            SetEvent(_rpcRequestEvent);
+            if (WaitForSingleObject(_rpcThread, 1000) == WAIT_OBJECT_0) {
+                std::shared_lock<std::shared_mutex> l(_handleMutex);
+                VirtualFreeEx(_handle, (void*)_rpcBlock, 0, MEM_RELEASE);
+            }
+        }
+
+        // Anything still in flight will never complete.
+        for (auto& promise : _rpcPromises) {
+            if (!promise) continue;
+            promise->set_value(0);
+            promise.reset();
+        }
+    }
+    _rpcSlotFreed.notify_all();
+
+    SetEvent(_rpcCompletionEvent); // Wake the collector so that it notices we've stopped
+    if (_rpcCollector.joinable()) _rpcCollector.join();
+
+    CloseHandle(_rpcThread);
+    CloseHandle(_rpcRequestEvent);
+    CloseHandle(_rpcCompletionEvent);
+    _rpcThread = nullptr;
+    _rpcRequestEvent = nullptr;
+    _rpcCompletionEvent = nullptr;
+    _rpcBlock = 0;
+}
+
+void Memory::CollectRpcResults() {
+    SetCurrentThreadName(L"RPC Collector");
+
+    while (true) {
+        WaitForSingleObject(_rpcCompletionEvent, INFINITE);
+        std::lock_guard<std::mutex> l(_rpcMutex);
+        if (!_rpcActive) break;
+
+        // One read covers the entire ring, no matter how many calls completed since we last woke up.
+        RpcSlot slots[RPC_SLOTS];
+        static_assert(sizeof(RpcHeader) + sizeof(slots) <= 0x1000, "The ring must fit within a single page");
+        ReadDataInternal(slots, _rpcBlock + sizeof(RpcHeader), sizeof(slots));
+        for (int i = 0; i < RPC_SLOTS; i++) {
+            if (!_rpcPromises[i] || slots[i].state != RpcState::Done) continue;
+            _rpcPromises[i]->set_value(slots[i].result);
+            _rpcPromises[i].reset();
+        }
+        _rpcSlotFreed.notify_all();
+    }
+}
+
 void Memory::ClearComputedAddress(const std::vector<__int64>& offsets) {
     uintptr_t address = ComputeOffset(offsets);
     _computedAddresses.Remove(address);
@@ -283,27 +714,41 @@ void Memory::ClearAllComputedAddresses() {
     _computedAddresses.Clear();
 }
 
-void Memory::ReadDataInternal(void* buffer, uintptr_t computedOffset, size_t bufferSize) {
+size_t Memory::ReadDataInternal(void* buffer, uintptr_t computedOffset, size_t bufferSize) {
     assert(bufferSize > 0, "[Internal error] Attempting to read 0 bytes");
-    if (!_handle) return;
     // Ensure that the buffer size does not cause a read across a page boundary.
     if (bufferSize > 0x1000 - (computedOffset & 0x0000FFF)) {
         bufferSize = 0x1000 - (computedOffset & 0x0000FFF);
     }
-    if (!ReadProcessMemory(_handle, (void*)computedOffset, buffer, bufferSize, nullptr)) {
+    BOOL succeeded = FALSE;
+    {
+        std::shared_lock<std::shared_mutex> l(_handleMutex); // Not held across the assert dialog, which would stall the heartbeat
+        if (!_handle) return 0;
+        succeeded = ReadProcessMemory(_handle, (void*)computedOffset, buffer, bufferSize, nullptr);
+    }
+    if (!succeeded) {
         assert(false, "Failed to read process memory.");
+        return 0;
     }
+    return bufferSize;
 }
 
-void Memory::WriteDataInternal(const void* buffer, uintptr_t computedOffset, size_t bufferSize) {
+size_t Memory::WriteDataInternal(const void* buffer, uintptr_t computedOffset, size_t bufferSize) {
     assert(bufferSize > 0, "[Internal error] Attempting to write 0 bytes");
-    if (!_handle) return;
     if (bufferSize > 0x1000 - (computedOffset & 0x0000FFF)) {
         bufferSize = 0x1000 - (computedOffset & 0x0000FFF);
     }
-    if (!WriteProcessMemory(_handle, (void*)computedOffset, buffer, bufferSize, nullptr)) {
+    BOOL succeeded = FALSE;
+    {
+        std::shared_lock<std::shared_mutex> l(_handleMutex);
+        if (!_handle) return 0;
+        succeeded = WriteProcessMemory(_handle, (void*)computedOffset, buffer, bufferSize, nullptr);
+    }
+    if (!succeeded) {
         assert(false, "Failed to write process memory.");
+        return 0;
     }
+    return bufferSize;
 }
 
 uintptr_t Memory::ComputeOffset(const std::vector<__int64>& offsets) {
@@ -324,8 +769,13 @@ uintptr_t Memory::ComputeOffset(const std::vector<__int64>& offsets) {
 
         // If the address was not yet computed, read it from memory.
         uintptr_t computedAddress = 0;
-        if (!_handle) return 0;
-        if (ReadProcessMemory(_handle, reinterpret_cast<LPCVOID>(cumulativeAddress), &computedAddress, _pointerSize, NULL) && computedAddress != 0) {
+        BOOL read = FALSE;
+        {
+            std::shared_lock<std::shared_mutex> l(_handleMutex);
+            if (!_handle) return 0;
+            read = ReadProcessMemory(_handle, reinterpret_cast<LPCVOID>(cumulativeAddress), &computedAddress, _pointerSize, NULL);
+        }
+        if (read && computedAddress != 0) {
             // Success!
             _computedAddresses.Set(cumulativeAddress, computedAddress);
             cumulativeAddress = computedAddress;
@@ -351,9 +801,12 @@ uintptr_t Memory::ResolvePointerPath(const std::vector<__int64>& offsets) {
     for (__int64 offset : offsets) {
         cumulativeAddress += offset;
 
-        if (!_handle) return 0;
         uintptr_t computedAddress = 0;
-        if (!ReadProcessMemory(_handle, reinterpret_cast<LPCVOID>(cumulativeAddress), &computedAddress, _pointerSize, NULL)) return 0;
+        {
+            std::shared_lock<std::shared_mutex> l(_handleMutex);
+            if (!_handle) return 0;
+            if (!ReadProcessMemory(_handle, reinterpret_cast<LPCVOID>(cumulativeAddress), &computedAddress, _pointerSize, NULL)) return 0;
+        }
         if (cumulativeAddress == 0) return 0;
         cumulativeAddress = computedAddress;
     }
@@ -361,53 +814,594 @@ uintptr_t Memory::ResolvePointerPath(const std::vector<__int64>& offsets) {
     return cumulativeAddress;
 }
 
-void Memory::Intercept(const std::string& name, __int64 firstLine, __int64 nextLine, const std::vector<byte>& data, bool writeOriginalCode) {
-    std::vector<byte> jumpBack = {
-        0x41, 0x53,                                 // push r11
-        0x49, 0xBB, LONG_TO_BYTES(firstLine + 15),  // mov r11, firstLine + 15
-        0x41, 0xFF, 0xE3,                           // jmp r11
+std::vector<byte> Memory::ReadOriginalCode(uintptr_t address, size_t size) {
+    std::vector<byte> data(size);
+    if (size > 0) data.resize(ReadAcrossPages(&data[0], address, size));
+
+    std::vector<std::pair<uintptr_t, std::vector<byte>>> originals;
+    {
+        std::lock_guard<std::mutex> l(_journalMutex);
+        for (const auto& entry : _journal) originals.emplace_back(entry.address, entry.originalBytes);
+    }
+    UndoEdits(originals, address, data);
+    return data;
+}
+
+std::vector<byte> Memory::ReadAcrossPages(uintptr_t address, size_t size) {
+    std::vector<byte> data(size);
+    if (size > 0) ReadAcrossPages(&data[0], address, size);
+    return data;
+}
+
+size_t Memory::ReadAcrossPages(void* buffer, uintptr_t address, size_t size) {
+    size_t i = 0;
+    while (i < size) {
+        size_t chunkSize = std::min(size - i, 0x1000 - ((address + i) & 0xFFF));
+        if (ReadDataInternal(static_cast<byte*>(buffer) + i, address + i, chunkSize) != chunkSize) break;
+        i += chunkSize;
+    }
+    return i;
+}
+
+size_t Memory::WriteAcrossPages(const byte* buffer, uintptr_t address, size_t size) {
+    size_t i = 0;
+    while (i < size) {
+        size_t chunkSize = std::min(size - i, 0x1000 - ((address + i) & 0xFFF));
+        if (WriteDataInternal(buffer + i, address + i, chunkSize) != chunkSize) break;
+        i += chunkSize;
+    }
+    return i;
+}
+
+bool Memory::Commit(const PatchTransaction& patch) {
+    if (!_handle) return false;
+    if (patch._edits.empty()) return true;
+    std::lock_guard<std::mutex> l(_journalMutex);
+
+    std::vector<JournalEntry> entries;
+    std::vector<std::pair<uintptr_t, std::vector<byte>>> edits;
+    for (const auto& edit : patch._edits) {
+        entries.push_back({edit.feature, edit.address, ReadAcrossPages(edit.address, edit.newBytes.size()), edit.newBytes});
+        edits.emplace_back(edit.address, edit.newBytes);
+    }
+    // A failed batch is rolled back, so there is nothing to journal... unless the rollback failed as well. Any edit which is still in place
+    // is journaled anyway, so that its feature is kept (and its allocations aren't freed) until the edit can be reverted.
+    const bool applied = ApplyEdits(edits, true);
+    for (const auto& entry : entries) {
+        if (!applied && ReadAcrossPages(entry.address, entry.originalBytes.size()) == entry.originalBytes) continue;
+        _journal.push_back(entry);
+        _featureEnabled[entry.feature] = true;
+    }
+    return applied;
+}
+
+bool Memory::ApplyJournal(const std::string& feature) {
+    // Disabled features are reverted in reverse order, in case any of their edits overlapped.
+    std::vector<std::pair<uintptr_t, std::vector<byte>>> reverts;
+    for (auto it = _journal.rbegin(); it != _journal.rend(); ++it) {
+        if (!feature.empty() && it->feature != feature) continue;
+        if (!_featureEnabled[it->feature]) reverts.emplace_back(it->address, it->originalBytes);
+    }
+    std::vector<std::pair<uintptr_t, std::vector<byte>>> applies;
+    for (const auto& entry : _journal) {
+        if (!feature.empty() && entry.feature != feature) continue;
+        if (_featureEnabled[entry.feature]) applies.emplace_back(entry.address, entry.newBytes);
+    }
+
+    bool succeeded = true;
+    if (!reverts.empty()) succeeded &= ApplyEdits(reverts, false);
+    if (!applies.empty()) succeeded &= ApplyEdits(applies, true);
+    return succeeded;
+}
+
+bool Memory::SetFeatureEnabled(const std::string& feature, bool enabled) {
+    std::lock_guard<std::mutex> l(_journalMutex);
+    auto search = _featureEnabled.find(feature);
+    if (search == _featureEnabled.end()) return false;
+    if (search->second == enabled) return true;
+    search->second = enabled;
+    if (ApplyJournal(feature)) return true;
+    search->second = !enabled;
+    return false;
+}
+
+bool Memory::RemoveFeature(const std::string& feature) {
+    std::lock_guard<std::mutex> l(_journalMutex);
+    auto search = _featureEnabled.find(feature);
+    if (search != _featureEnabled.end()) {
+        search->second = false;
+        if (!ApplyJournal(feature)) {
+            // The game code may still jump into the feature's allocations, so it is kept (disabled) rather than freed.
+            DebugPrint("Failed to revert " + feature + ", so it was not removed");
+            return false;
+        }
+        _featureEnabled.erase(search);
+        _journal.erase(std::remove_if(_journal.begin(), _journal.end(), [&feature](const JournalEntry& entry) { return entry.feature == feature; }), _journal.end());
+    }
+    _journalValues.erase(feature);
+
+    // A feature may own allocations without having any edits yet (e.g. if it failed to attach).
+    auto allocations = _featureAllocations.find(feature);
+    if (allocations == _featureAllocations.end()) return true;
+    FreeAllocations(allocations->second);
+    _featureAllocations.erase(allocations);
+    return true;
+}
+
+bool Memory::RemoveAllFeatures() {
+    std::lock_guard<std::mutex> l(_journalMutex);
+    std::vector<std::pair<uintptr_t, std::vector<byte>>> reverts;
+    for (auto it = _journal.rbegin(); it != _journal.rend(); ++it) reverts.emplace_back(it->address, it->originalBytes);
+    // If the code can't be reverted, everything is kept, so that the journal can still restore (or remove) it later.
+    if (!reverts.empty() && !ApplyEdits(reverts, false)) return false;
+    for (const auto& [feature, allocations] : _featureAllocations) FreeAllocations(allocations);
+
+    _journal.clear();
+    _featureEnabled.clear();
+    _journalValues.clear();
+    _featureAllocations.clear();
+    return true;
+}
+
+bool Memory::HasFeature(const std::string& feature) {
+    std::lock_guard<std::mutex> l(_journalMutex);
+    return _featureEnabled.find(feature) != _featureEnabled.end();
+}
+
+void Memory::AddFeatureAllocation(const std::string& feature, uintptr_t address) {
+    if (address == 0) return;
+    std::lock_guard<std::mutex> l(_journalMutex);
+    _featureAllocations[feature].push_back(address);
+}
+
+void Memory::FreeAllocations(const std::vector<uintptr_t>& allocations) {
+    std::shared_lock<std::shared_mutex> l(_handleMutex);
+    if (!_handle) return;
+    for (uintptr_t allocation : allocations) VirtualFreeEx(_handle, (void*)allocation, 0, MEM_RELEASE);
+}
+
+void Memory::SetJournalValue(const std::string& feature, const std::string& name, uint64_t value) {
+    std::lock_guard<std::mutex> l(_journalMutex);
+    _journalValues[feature][name] = value;
+}
+
+uint64_t Memory::GetJournalValue(const std::string& feature, const std::string& name) {
+    std::lock_guard<std::mutex> l(_journalMutex);
+    auto values = _journalValues.find(feature);
+    if (values == _journalValues.end()) return 0;
+    auto search = values->second.find(name);
+    return (search == values->second.end() ? 0 : search->second);
+}
+
+uint64_t Memory::GetProcessCreationTime() {
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    std::shared_lock<std::shared_mutex> l(_handleMutex);
+    if (!GetProcessTimes(_handle, &creationTime, &exitTime, &kernelTime, &userTime)) return 0;
+    return (static_cast<uint64_t>(creationTime.dwHighDateTime) << 32) | creationTime.dwLowDateTime;
+}
+
+#define JOURNAL_HEADER "BluePrinceRandomizer patch journal v2"
+bool Memory::SaveJournal(const std::wstring& path) {
+    std::lock_guard<std::mutex> l(_journalMutex);
+    if (!_handle) return false;
+
+    auto toHex = [](const std::vector<byte>& bytes) {
+        std::stringstream ss;
+        ss << std::hex << std::uppercase << std::setfill('0');
+        for (byte b : bytes) ss << std::setw(2) << static_cast<int>(b);
+        return ss.str();
+    };
+
+    std::ofstream file{std::filesystem::path(path), std::ios::trunc};
+    if (!file) return false;
+    file << JOURNAL_HEADER << '\n';
+    file << "process " << _pid << ' ' << GetProcessCreationTime() << '\n';
+    for (const auto& [feature, values] : _journalValues) {
+        for (const auto& [name, value] : values) file << "value " << feature << ' ' << name << ' ' << std::hex << value << std::dec << '\n';
+    }
+    for (const auto& [feature, enabled] : _featureEnabled) {
+        file << "feature " << feature << ' ' << enabled << '\n';
+    }
+    for (const auto& [feature, allocations] : _featureAllocations) {
+        for (uintptr_t allocation : allocations) file << "alloc " << feature << ' ' << std::hex << allocation << std::dec << '\n';
+    }
+    for (const auto& entry : _journal) {
+        file << "edit " << entry.feature << ' ' << std::hex << entry.address << std::dec << ' ' << toHex(entry.originalBytes) << ' ' << toHex(entry.newBytes) << '\n';
+    }
+    return file.good();
+}
+
+bool Memory::LoadJournal(const std::wstring& path) {
+    std::lock_guard<std::mutex> l(_journalMutex);
+    if (!_handle) return false;
+
+    std::ifstream file{std::filesystem::path(path)};
+    std::string line;
+    if (!std::getline(file, line) || line != JOURNAL_HEADER) return false;
+
+    // The inverse of toHex in SaveJournal. The journal is a file on disk, so it is checked rather than trusted.
+    auto fromHex = [](const std::string& hex, std::vector<byte>& bytes) {
+        if (hex.size() % 2 != 0) return false;
+        if (!std::all_of(hex.begin(), hex.end(), [](char ch) { return std::isxdigit(static_cast<unsigned char>(ch)) != 0; })) return false;
+        bytes.resize(hex.size() / 2);
+        for (size_t i = 0; i < bytes.size(); i++) bytes[i] = static_cast<byte>(std::stoul(hex.substr(i * 2, 2), nullptr, 16));
+        return true;
     };
 
+    DWORD pid = 0;
+    uint64_t creationTime = 0;
+    std::vector<JournalEntry> journal;
+    std::map<std::string, bool> featureEnabled;
+    std::map<std::string, std::map<std::string, uint64_t>> journalValues;
+    std::map<std::string, std::vector<uintptr_t>> featureAllocations;
+    while (std::getline(file, line)) {
+        // Every field has to parse, and nothing may follow the last one. Anything else means the line is corrupt, and so is the journal.
+        std::istringstream ss(line);
+        auto parsed = [&ss] { return !ss.fail() && (ss >> std::ws).eof(); };
+        std::string kind, name;
+        if (!(ss >> kind)) return false;
+        if (kind == "process") {
+            if (!(ss >> pid >> creationTime) || !parsed()) return false;
+        } else if (kind == "value") {
+            std::string valueName;
+            uint64_t value = 0;
+            if (!(ss >> name >> valueName >> std::hex >> value) || !parsed()) return false;
+            journalValues[name][valueName] = value;
+        } else if (kind == "feature") {
+            bool enabled = false;
+            if (!(ss >> name >> enabled) || !parsed()) return false;
+            featureEnabled[name] = enabled;
+        } else if (kind == "alloc") {
+            uintptr_t allocation = 0;
+            if (!(ss >> name >> std::hex >> allocation) || !parsed() || allocation == 0) return false;
+            featureAllocations[name].push_back(allocation);
+        } else if (kind == "edit") {
+            JournalEntry entry;
+            std::string originalHex, newHex;
+            if (!(ss >> entry.feature >> std::hex >> entry.address >> originalHex >> newHex) || !parsed() || entry.address == 0) return false;
+            if (!fromHex(originalHex, entry.originalBytes) || !fromHex(newHex, entry.newBytes)) return false;
+            if (entry.originalBytes.empty() || entry.originalBytes.size() != entry.newBytes.size()) return false;
+            journal.push_back(entry);
+        } else {
+            return false;
+        }
+    }
+
+    // Addresses (both in the game code and in our allocations) are only meaningful for the exact process we saved from.
+    if (pid != _pid || creationTime != GetProcessCreationTime()) return false;
+    // Every edit should still be either fully applied or fully reverted; anything else means we don't understand the current state.
+    for (const auto& entry : journal) {
+        std::vector<byte> current = ReadAcrossPages(entry.address, entry.originalBytes.size());
+        if (current != entry.originalBytes && current != entry.newBytes) return false;
+    }
+
+    _journal = journal;
+    _featureEnabled = featureEnabled;
+    _journalValues = journalValues;
+    _featureAllocations = featureAllocations;
+    // Even if the edits can't be brought in line, the journal still describes the code, so it is kept for removing the features later.
+    return ApplyJournal("");
+}
+#undef JOURNAL_HEADER
+
+bool Memory::ApplyEdits(const std::vector<std::pair<uintptr_t, std::vector<byte>>>& allEdits, bool largeEditsFirst) {
+    if (!_handle) return false;
+
+    // Skip any edits which are already in place (e.g. rolling back code which has already been restored).
+    std::vector<std::pair<uintptr_t, std::vector<byte>>> edits;
+    std::vector<std::vector<byte>> originals; // The current bytes under each edit, so that a failed batch can be rolled back
+    for (const auto& edit : allEdits) {
+        std::vector<byte> current = ReadAcrossPages(edit.first, edit.second.size());
+        if (current == edit.second) continue;
+        edits.push_back(edit);
+        originals.push_back(current);
+    }
+    if (edits.empty()) return true;
+
+    if (!_patchHelpers) {
+        std::vector<byte> helperInstructions = {
+            // Exchange16(rcx = 16-byte aligned destination, rdx = low qword, r8 = high qword)
+            0x53,                                   // push rbx                     ;
+            0x49, 0x89, 0xCA,                       // mov r10, rcx                 ; r10 = destination
+            0x48, 0x89, 0xD3,                       // mov rbx, rdx                 ; rcx:rbx = the new value
+            0x4C, 0x89, 0xC1,                       // mov rcx, r8                  ;
+            0x49, 0x8B, 0x02,                       // mov rax, [r10]               ; rdx:rax = the current value
+            0x49, 0x8B, 0x52, 0x08,                 // mov rdx, [r10+8]             ;
+            DO_WHILE_NONZERO(                       // do {                         ;
+              0xF0, 0x49, 0x0F, 0xC7, 0x0A          //   lock cmpxchg16b [r10]      ;   On failure, this reloads rdx:rax with the current value
+            ),                                      // } while (!ZF)                ;
+            0x5B,                                   // pop rbx                      ;
+            0xB8, INT_TO_BYTES(1),                  // mov eax, 1                   ; Report success (the RPC worker returns 0 if it's unavailable)
+            0xC3,                                   // ret                          ;
+            0x90,                                   // nop                          ; (padding to 0x20)
+            // Exchange2(rcx = destination, dx = value)
+            0x66, 0x87, 0x11,                       // xchg word ptr [rcx], dx      ; Implicitly locked, so this is atomic even when unaligned
+            0xB8, INT_TO_BYTES(1),                  // mov eax, 1                   ;
+            0xC3,                                   // ret                          ;
+        };
+        assert(helperInstructions.size() == 0x29, "[INTERNAL ERROR] Patch helpers were resized without updating their offsets");
+        _patchHelpers = AllocateArray(helperInstructions.size());
+        if (_patchHelpers == 0) return false;
+        WriteDataInternal(&helperInstructions[0], _patchHelpers, helperInstructions.size());
+    }
+    const __int64 exchange16 = _patchHelpers;
+    const __int64 exchange2 = _patchHelpers + 0x20;
+
+    // Make each page writable (since some of the writes happen from inside the target process), exactly once.
+    std::map<uintptr_t, DWORD> pageProtections;
+    for (const auto& [address, bytes] : edits) {
+        for (uintptr_t page = address & ~0xFFFull; page < address + bytes.size(); page += 0x1000) {
+            if (pageProtections.find(page) != pageProtections.end()) continue;
+            DWORD oldProtect = 0;
+            std::shared_lock<std::shared_mutex> l(_handleMutex);
+            VirtualProtectEx(_handle, (void*)page, 0x1000, PAGE_EXECUTE_READWRITE, &oldProtect);
+            pageProtections[page] = oldProtect;
+        }
+    }
+
+    // Sort the edits into ones which can be written with a single 16-byte exchange, and ones which need a guard.
+    auto sameBlock = [](uintptr_t address, size_t size) { return (address & ~0xFull) == ((address + size - 1) & ~0xFull); };
+    std::vector<size_t> guarded;
+    std::vector<size_t> unguarded;
+    for (size_t i = 0; i < edits.size(); i++) {
+        if (!sameBlock(edits[i].first, edits[i].second.size())) guarded.push_back(i);
+    }
+    // If an atomic edit shares a block with a guarded edit, exchanging the block would race with the guard. Guard it as well.
+    std::map<uintptr_t, std::vector<byte>> blocks; // 16-byte aligned address : merged contents
+    std::map<uintptr_t, std::vector<byte>> originalBlocks;
+    for (size_t i = 0; i < edits.size(); i++) {
+        const auto& [address, bytes] = edits[i];
+        if (!sameBlock(address, bytes.size())) continue;
+        uintptr_t block = address & ~0xFull;
+        bool overlapsGuard = false;
+        for (size_t j : guarded) {
+            if (edits[j].first < block + 0x10 && block < edits[j].first + edits[j].second.size()) overlapsGuard = true;
+        }
+        if (overlapsGuard) {
+            guarded.push_back(i);
+            continue;
+        }
+        unguarded.push_back(i);
+        if (blocks.find(block) == blocks.end()) blocks[block] = originalBlocks[block] = ReadAcrossPages(block, 0x10);
+        std::copy(bytes.begin(), bytes.end(), blocks[block].begin() + (address - block));
+    }
+
+    // Every write to live game code goes through the RPC worker, since only it can exchange the bytes atomically. If any call fails,
+    // the rest of its round is undone, and the batch reports failure rather than writing the bytes directly (which could tear).
+    std::vector<size_t> applied; // Edits which are fully in place
+    auto exchangeBlocks = [&](const std::map<uintptr_t, std::vector<byte>>& contents, const std::vector<uintptr_t>& which) {
+        std::vector<FunctionCall> calls;
+        for (uintptr_t block : which) {
+            const std::vector<byte>& bytes = contents.at(block);
+            calls.push_back({exchange16, (__int64)block, *(const __int64*)&bytes[0], *(const __int64*)&bytes[8]});
+        }
+        std::vector<std::future<__int64>> results = CallFunctions(calls);
+        std::vector<uintptr_t> exchanged;
+        for (size_t i = 0; i < which.size(); i++) {
+            if (results[i].get() != 0) exchanged.push_back(which[i]);
+        }
+        return exchanged;
+    };
+    auto exchangeGuards = [&](const std::vector<size_t>& which, const std::function<uint16_t(size_t)>& value) {
+        std::vector<FunctionCall> calls;
+        for (size_t i : which) calls.push_back({exchange2, (__int64)edits[i].first, (__int64)value(i)});
+        std::vector<std::future<__int64>> results = CallFunctions(calls);
+        std::vector<size_t> exchanged;
+        for (size_t j = 0; j < which.size(); j++) {
+            if (results[j].get() != 0) exchanged.push_back(which[j]);
+        }
+        return exchanged;
+    };
+    auto firstTwo = [](const std::vector<byte>& bytes) { return static_cast<uint16_t>(bytes[0] | (bytes[1] << 8)); };
+
+    auto applyAtomicEdits = [&] {
+        std::vector<uintptr_t> all;
+        for (const auto& [block, bytes] : blocks) all.push_back(block);
+        std::vector<uintptr_t> exchanged = exchangeBlocks(blocks, all);
+        if (exchanged.size() != all.size()) {
+            if (exchangeBlocks(originalBlocks, exchanged).size() != exchanged.size()) assert(false, "Failed to roll back an atomic code edit");
+            return false;
+        }
+        applied.insert(applied.end(), unguarded.begin(), unguarded.end());
+        return true;
+    };
+
+    auto applyGuardedEdits = [&] {
+        // Single bytes are written directly, since they can't tear.
+        std::vector<size_t> multiByte;
+        for (size_t i : guarded) {
+            if (edits[i].second.size() >= 2) multiByte.push_back(i);
+        }
+
+        // Step 1: Put a 'jmp $' at the start of each edit, so that game threads wait there.
+        std::vector<size_t> placed = exchangeGuards(multiByte, [](size_t) { return static_cast<uint16_t>(0xFEEB); }); // jmp $
+        if (placed.size() != multiByte.size()) {
+            if (exchangeGuards(placed, [&](size_t i) { return firstTwo(originals[i]); }).size() != placed.size()) assert(false, "Failed to remove a code guard");
+            return false;
+        }
+
+        // Step 2: We are now free to write the rest of each edit. If a write fails, every edit goes back to its original bytes instead.
+        auto writeRest = [&](const std::vector<std::vector<byte>>& contents, const std::vector<size_t>& which) {
+            bool written = true;
+            for (size_t i : which) {
+                const std::vector<byte>& bytes = contents[i];
+                const uintptr_t address = edits[i].first;
+                if (bytes.size() < 2) {
+                    written &= (WriteAcrossPages(&bytes[0], address, bytes.size()) == bytes.size());
+                } else if (bytes.size() > 2) {
+                    written &= (WriteAcrossPages(&bytes[2], address + 2, bytes.size() - 2) == bytes.size() - 2);
+                }
+            }
+            return written;
+        };
+        std::vector<std::vector<byte>> newBytes(edits.size());
+        for (size_t i : guarded) newBytes[i] = edits[i].second;
+        const bool written = writeRest(newBytes, guarded);
+        if (!written && !writeRest(originals, guarded)) assert(false, "Failed to restore code behind a guard");
+        const std::vector<std::vector<byte>>& released = written ? newBytes : originals;
+
+        // Step 3: Replace the guards with the first two bytes of each edit (or the original bytes), releasing any waiting threads.
+        // A guard which can't be released leaves game threads parked on it, but writing the bytes directly could tear the instruction they are spinning on,
+        // so it is retried a few times instead.
+        std::vector<size_t> stuck = multiByte;
+        for (int attempt = 0; attempt < s_guardReleaseAttempts && !stuck.empty(); attempt++) {
+            std::vector<size_t> freed = exchangeGuards(stuck, [&](size_t i) { return firstTwo(released[i]); });
+            stuck.erase(std::remove_if(stuck.begin(), stuck.end(), [&freed](size_t i) { return std::find(freed.begin(), freed.end(), i) != freed.end(); }), stuck.end());
+        }
+        if (!written) return false;
+        for (size_t i : guarded) {
+            if (std::find(stuck.begin(), stuck.end(), i) == stuck.end()) applied.push_back(i);
+        }
+        if (stuck.empty()) return true;
+        assert(false, "Failed to release a code guard");
+        return false;
+    };
+
+    // Small edits are usually redirects (e.g. a call target) into code written by the large edits,
+    // so they must go in last, and come out first.
+    bool succeeded = largeEditsFirst ? (applyGuardedEdits() && applyAtomicEdits()) : (applyAtomicEdits() && applyGuardedEdits());
+
+    for (const auto& [page, oldProtect] : pageProtections) {
+        DWORD unused = 0;
+        std::shared_lock<std::shared_mutex> l(_handleMutex);
+        VirtualProtectEx(_handle, (void*)page, 0x1000, oldProtect, &unused);
+        FlushInstructionCache(_handle, (void*)page, 0x1000);
+    }
+    if (succeeded) return true;
+
+    // The batch is all or nothing, so take out whatever went in before the failure (in the opposite order).
+    // Each rollback covers fewer edits than the batch it undoes, so this always ends.
+    if (!applied.empty()) {
+        std::vector<std::pair<uintptr_t, std::vector<byte>>> rollback;
+        for (size_t i : applied) rollback.emplace_back(edits[i].first, originals[i]);
+        if (!ApplyEdits(rollback, !largeEditsFirst)) assert(false, "Failed to roll back a partially applied batch of code edits");
+    }
+    return false;
+}
+
+void Memory::Intercept(PatchTransaction& patch, const std::string& name, __int64 firstLine, __int64 nextLine, const std::vector<byte>& data, bool writeOriginalCode) {
+    std::vector<byte> replacedCode = ReadData<byte>({firstLine}, nextLine - firstLine);
+
+    // If we can place the trampoline within rel32 range of the game code, we can use 5-byte jumps in both directions.
+    // Otherwise, fall back to an absolute jump through r11 (which needs 15 bytes, plus a push/pop of r11).
+    __int64 trampolineSize = data.size() + replacedCode.size() + 0x20; // Enough for either form of jump
+    uintptr_t addr = AllocateArrayNear(firstLine, trampolineSize);
+    bool nearJump = (addr != 0);
+    if (!nearJump) addr = AllocateArray(trampolineSize);
+
 #pragma warning (push)
 #pragma warning (disable: 4530)
-    std::vector<byte> injectionBytes = {0x41, 0x5B}; // pop r11 (before executing code that might need it)
+    std::vector<byte> injectionBytes;
+    if (!nearJump) injectionBytes = {0x41, 0x5B}; // pop r11 (before executing code that might need it)
     injectionBytes.insert(injectionBytes.end(), data.begin(), data.end());
     injectionBytes.push_back(0x90); // Padding nop
-    std::vector<byte> replacedCode = ReadData<byte>({firstLine}, nextLine - firstLine);
     if (writeOriginalCode) {
         injectionBytes.insert(injectionBytes.end(), replacedCode.begin(), replacedCode.end());
         injectionBytes.push_back(0x90); // Padding nop
     }
-    injectionBytes.insert(injectionBytes.end(), jumpBack.begin(), jumpBack.end());
+    if (nearJump) {
+        int32_t jumpBack = static_cast<int32_t>(nextLine - (addr + injectionBytes.size() + 5));
+        injectionBytes.insert(injectionBytes.end(), {
+            0xE9, INT_TO_BYTES(jumpBack),           // jmp nextLine
+        });
+    } else {
+        injectionBytes.insert(injectionBytes.end(), {
+            0x41, 0x53,                                 // push r11
+            0x49, 0xBB, LONG_TO_BYTES(firstLine + 15),  // mov r11, firstLine + 15
+            0x41, 0xFF, 0xE3,                           // jmp r11
+        });
+    }
 #pragma warning (pop)
 
-    uintptr_t addr = AllocateArray(injectionBytes.size());
     WriteData<byte>({(__int64)addr}, injectionBytes);
 
-    std::vector<byte> jumpAway = {
-        0x41, 0x53,                         // push r11
-        0x49, 0xBB, LONG_TO_BYTES(addr),    // mov r11, addr
-        0x41, 0xFF, 0xE3,                   // jmp r11
-        0x41, 0x5B,                         // pop r11 (we return to this opcode)
-    };
+    std::vector<byte> jumpAway;
+    if (nearJump) {
+        int32_t jumpAwayOffset = static_cast<int32_t>(addr - (firstLine + 5));
+        jumpAway = {
+            0xE9, INT_TO_BYTES(jumpAwayOffset),     // jmp addr
+        };
+    } else {
+        jumpAway = {
+            0x41, 0x53,                         // push r11
+            0x49, 0xBB, LONG_TO_BYTES(addr),    // mov r11, addr
+            0x41, 0xFF, 0xE3,                   // jmp r11
+            0x41, 0x5B,                         // pop r11 (we return to this opcode)
+        };
+    }
     // We need enough space for the jump in the source code
     assert(static_cast<int>(nextLine - firstLine) >= jumpAway.size(), "[INTERNAL ERROR] Injection did not have enough space for jump away/jump back");
 
     // Fill any leftover space with nops
     for (size_t i=jumpAway.size(); i<static_cast<size_t>(nextLine - firstLine); i++) jumpAway.push_back(0x90);
-    WriteData<byte>({firstLine}, jumpAway);
+    patch.Write(name, firstLine, jumpAway);
 
-    _interceptions.push_back({name, firstLine, replacedCode, addr});
+    // The trampoline is owned by the feature, so that we can free it when the interception is removed.
+    AddFeatureAllocation(name, addr);
 }
 
 void Memory::Unintercept(const std::string& name) {
-    auto search = std::find_if(_interceptions.begin(), _interceptions.end(), [&name](Interception i) { return i.name == name; });
-    if (search == _interceptions.end()) return;
-    Interception interception = *search;
-    WriteData<byte>({interception.firstLine}, interception.replacedCode);
-    VirtualFreeEx(_handle, (void*)interception.addr, 0, MEM_RELEASE);
+    RemoveFeature(name);
 }
 
 uintptr_t Memory::AllocateArray(__int64 size) {
+    std::shared_lock<std::shared_mutex> l(_handleMutex);
     return (uintptr_t)VirtualAllocEx(_handle, 0, size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+}
+
+uintptr_t Memory::AllocateArrayNear(__int64 target, __int64 size) {
+    if (!_handle) return 0;
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    const uintptr_t granularity = systemInfo.dwAllocationGranularity;
+    auto alignDown = [granularity](uintptr_t address) { return address & ~(granularity - 1); };
+    auto alignUp = [granularity](uintptr_t address) { return (address + granularity - 1) & ~(granularity - 1); };
+
+    // rel32 reaches +/-2 GB from the end of the jump. Leave some slack, since the allocation itself has a size.
+    const uintptr_t range = 0x7FF00000;
+    const uintptr_t minAddress = std::max<uintptr_t>(target > range ? target - range : 0, (uintptr_t)systemInfo.lpMinimumApplicationAddress);
+    const uintptr_t maxAddress = std::min<uintptr_t>(target + range, (uintptr_t)systemInfo.lpMaximumApplicationAddress);
+
+    auto queryRegion = [&](uintptr_t address, MEMORY_BASIC_INFORMATION& info) {
+        std::shared_lock<std::shared_mutex> l(_handleMutex);
+        return VirtualQueryEx(_handle, (void*)address, &info, sizeof(info)) != 0;
+    };
+    auto tryAllocate = [&](uintptr_t address) -> uintptr_t {
+        if (address < minAddress || address + size > maxAddress) return 0;
+        std::shared_lock<std::shared_mutex> l(_handleMutex);
+        return (uintptr_t)VirtualAllocEx(_handle, (void*)address, size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+    };
+
+    // Walk the free regions above the target (usually just past the end of the module)...
+    MEMORY_BASIC_INFORMATION info;
+    for (uintptr_t address = alignUp(target); address < maxAddress;) {
+        if (!queryRegion(address, info)) break;
+        uintptr_t regionEnd = (uintptr_t)info.BaseAddress + info.RegionSize;
+        if (info.State == MEM_FREE) {
+            uintptr_t candidate = alignUp((uintptr_t)info.BaseAddress);
+            if (candidate + size <= regionEnd) {
+                uintptr_t result = tryAllocate(candidate);
+                if (result) return result;
+            }
+        }
+        address = regionEnd;
+    }
+
+    // ...and then below it.
+    for (uintptr_t address = alignDown(target) - 1; address > minAddress;) {
+        if (!queryRegion(address, info)) break;
+        uintptr_t regionStart = (uintptr_t)info.BaseAddress;
+        uintptr_t regionEnd = regionStart + info.RegionSize;
+        if (info.State == MEM_FREE && regionEnd >= size) {
+            uintptr_t candidate = alignDown(regionEnd - size);
+            if (candidate >= regionStart) {
+                uintptr_t result = tryAllocate(candidate);
+                if (result) return result;
+            }
+        }
+        if (regionStart == 0) break;
+        address = regionStart - 1;
+    }
+
+    return 0;
 }
\ No newline at end of file
@@ -1,6 +1,10 @@
 #pragma once
+#include <atomic>
+#include <condition_variable>
+#include <shared_mutex>
 #include "ThreadSafeAddressMap.h"
 #include "ProcStatus.h"
+#include "Signature.h"
 
 using byte = unsigned char;
 
@@ -36,11 +40,41 @@ using byte = unsigned char;
 #define ARGCOUNT(...) std::tuple_size<decltype(std::make_tuple(__VA_ARGS__))>::value
 #define DO_WHILE_NONZERO(...) __VA_ARGS__, 0x75, static_cast<byte>(-2 - ARGCOUNT(__VA_ARGS__)) // Must end on a 'dec' instruction to set ZF correctly.
 
+// Cancelled when the process it was issued for exits, so that any work for that process can stop early.
+class CancellationToken final {
+public:
+    explicit CancellationToken(bool cancelled = false) : _cancelled(cancelled) { }
+    void Cancel() {
+        {
+            std::lock_guard<std::mutex> l(_mutex);
+            _cancelled = true;
+        }
+        _cancelledChanged.notify_all();
+    }
+    bool IsCancelled() const { return _cancelled; }
+    // Returns true (early) if the token is cancelled within the timeout.
+    bool WaitFor(std::chrono::milliseconds timeout) const {
+        std::unique_lock<std::mutex> l(_mutex);
+        return _cancelledChanged.wait_for(l, timeout, [this] { return _cancelled.load(); });
+    }
+
+private:
+    std::atomic<bool> _cancelled;
+    mutable std::mutex _mutex;
+    mutable std::condition_variable _cancelledChanged;
+};
+
 class Memory final {
 public:
     Memory(const std::wstring& processName, const std::wstring& moduleName) : _processName(processName), _moduleName(moduleName) { }
     ~Memory();
     ProcStatus TryAttachToProcess();
+    // Waits (for up to timeout) before the next TryAttachToProcess. Returns early if cancelEvent is set, or if the process exits once it has been found,
+    // so that exits are noticed immediately rather than on the next poll.
+    void WaitForProcessEvent(std::chrono::milliseconds timeout, HANDLE cancelEvent);
+    bool IsProcessFound() const { return _handle != nullptr || _launchingHandle != nullptr; }
+    // The token for the process we are attached to. If we aren't attached, the token is already cancelled.
+    std::shared_ptr<const CancellationToken> GetProcessToken() const { return std::atomic_load(&_processToken); }
 
     void BringToFront();
     bool IsForeground();
@@ -53,10 +87,48 @@ public:
     // bytesToEOL is the number of bytes from the given index to the end of the opcode. Usually, the target address is last 4 bytes, since it's the destination of the call.
     static __int64 ReadStaticInt(__int64 offset, int index, const std::vector<byte>& data, size_t bytesToEOL = 4);
     using ScanFunc = std::function<void(__int64 offset, int index, const std::vector<byte>& data)>;
-    using ScanFunc2 = std::function<bool(__int64 offset, int index, const std::vector<byte>& data)>;
-    void AddSigScan(const std::string& scanHex, const ScanFunc& scanFunc);
-    void AddSigScan2(const std::string& scanHex, const ScanFunc2& scanFunc);
+
+    // Each sigscan belongs to the handle which added it, and is removed when the handle is destroyed (or reset). Handles must not outlive the Memory.
+    // Process scans are also dropped when the process exits, since their results (and usually their callbacks) are only valid for that process.
+    // Session scans stay registered, and are run again against the next process.
+    enum class SigScanScope {
+        Process,
+        Session,
+    };
+    class SigScanHandle final {
+    public:
+        SigScanHandle() = default;
+        ~SigScanHandle() { Reset(); }
+        SigScanHandle(SigScanHandle&& other) noexcept { *this = std::move(other); }
+        SigScanHandle& operator=(SigScanHandle&& other) noexcept;
+        SigScanHandle(const SigScanHandle& other) = delete;
+        SigScanHandle& operator=(const SigScanHandle& other) = delete;
+
+        void Reset(); // Removes the sigscan
+        // The results are written by ExecuteSigScans, so only read them once it has returned.
+        bool Found() const { return !Addresses().empty(); }
+        uintptr_t Address() const { return Found() ? Addresses()[0] : 0; } // The first match
+        const std::vector<uintptr_t>& Addresses() const; // Every match, for AddSigScanAll
+
+    private:
+        friend class Memory;
+        struct Result {
+            std::vector<uintptr_t> addresses;
+        };
+        Memory* _memory = nullptr;
+        uint64_t _id = 0;
+        std::shared_ptr<Result> _result;
+    };
+    // scanFunc is optional. It is called with the chunk which contains the match, for scans which need to decode the surrounding code.
+    [[nodiscard]] SigScanHandle AddSigScan(const Signature& signature, SigScanScope scope, const ScanFunc& scanFunc = nullptr);
+    // Unlike the other sigscans, this finds every match (not just the first). It is only run by one ExecuteSigScans, which always reads the whole module.
+    [[nodiscard]] SigScanHandle AddSigScanAll(const std::vector<byte>& bytes, SigScanScope scope);
+    // Runs every pending sigscan in a single pass over the module. Returns the number of (single-match) sigscans which were not found.
     [[nodiscard]] size_t ExecuteSigScans();
+    // Reads code as the sigscans see it, with our journaled edits undone. Stops at the first page which fails, like ReadAcrossPages.
+    std::vector<byte> ReadOriginalCode(uintptr_t address, size_t size);
+    // Finds every rip-relative instruction (the opcode, followed by a disp32) which refers to one of the targets. The result is keyed by target.
+    std::map<uintptr_t, std::vector<uintptr_t>> FindRipRelativeReferences(const std::vector<byte>& opcode, const std::vector<uintptr_t>& targets);
 
     std::string ReadString(const std::vector<__int64>& offsets);
 
@@ -68,38 +140,155 @@ public:
         return data;
     }
 
+    // Reads into an existing vector (resized to numItems), so that repeated reads can reuse its capacity.
+    template<class T>
+    inline void ReadData(const std::vector<__int64>& offsets, size_t numItems, std::vector<T>& data) {
+        data.resize(numItems);
+        if (!_handle || numItems == 0) return;
+        ReadDataInternal(&data[0], ComputeOffset(offsets), numItems * sizeof(T));
+    }
+
     template <class T>
     inline void WriteData(const std::vector<__int64>& offsets, const std::vector<T>& data) {
         if (!_handle) return;
         WriteDataInternal(&data[0], ComputeOffset(offsets), sizeof(T) * data.size());
     }
 
+    // ReadData and WriteData stop at the end of the first page. These do not, for data which may cross a page boundary.
+    // Reads into an existing vector (resized to numItems), and returns the number of items which were read. Items after a page which
+    // could not be read are left zeroed.
+    template<class T>
+    inline size_t ReadDataAcrossPages(const std::vector<__int64>& offsets, size_t numItems, std::vector<T>& data) {
+        data.assign(numItems, T{});
+        if (!_handle || numItems == 0) return 0;
+        return ReadAcrossPages(&data[0], ComputeOffset(offsets), numItems * sizeof(T)) / sizeof(T);
+    }
+
+    template<class T>
+    inline std::vector<T> ReadDataAcrossPages(const std::vector<__int64>& offsets, size_t numItems) {
+        std::vector<T> data;
+        ReadDataAcrossPages(offsets, numItems, data);
+        return data;
+    }
+
+    // Returns the number of bytes which were written.
+    template <class T>
+    inline size_t WriteDataAcrossPages(const std::vector<__int64>& offsets, const std::vector<T>& data) {
+        if (!_handle || data.empty()) return 0;
+        return WriteAcrossPages(reinterpret_cast<const byte*>(&data[0]), ComputeOffset(offsets), sizeof(T) * data.size());
+    }
+
     uintptr_t ResolvePointerPath(const std::vector<__int64>& offsets);
     void ClearComputedAddress(const std::vector<__int64>& offsets);
     void ClearAllComputedAddresses();
 
-    void Intercept(const std::string& name, __int64 firstLine, __int64 nextLine, const std::vector<byte>& data, bool writeOriginalCode = true);
-    void Unintercept(const std::string& name);
+    // Edits to live game code are collected into a transaction, and then applied all at once.
+    // Each edit must start on an instruction boundary. Edits which fit inside an aligned 16-byte block are swapped in atomically;
+    // longer edits are first guarded with a 2-byte 'jmp $', so that game threads wait at the start of the edit until it is complete.
+    // On commit, the long edits are applied before the short ones (which are usually redirects into them); reverting does the reverse.
+    class PatchTransaction final {
+    public:
+        void Write(const std::string& feature, __int64 address, const std::vector<byte>& bytes) { _edits.push_back({feature, static_cast<uintptr_t>(address), bytes}); }
+        void Append(const PatchTransaction& other) { _edits.insert(_edits.end(), other._edits.begin(), other._edits.end()); }
+        bool Empty() const { return _edits.empty(); }
+
+    private:
+        friend class Memory;
+        struct Edit {
+            std::string feature;
+            uintptr_t address;
+            std::vector<byte> newBytes;
+        };
+        std::vector<Edit> _edits;
+    };
+    bool Commit(const PatchTransaction& patch); // Returns false (having changed nothing) if the edits can't all be written atomically
+
+    // Every committed edit is recorded in the patch journal, along with its original bytes and the feature which owns it.
+    // Each of these operations is applied as a single batch, and returns false if the batch could not be applied (in which case it is rolled back).
+    bool SetFeatureEnabled(const std::string& feature, bool enabled);
+    bool RemoveFeature(const std::string& feature); // Restores the original code, frees the feature's allocations, and forgets its edits and journal values.
+    bool RemoveAllFeatures(); // RemoveFeature, for every feature at once. This also forgets the journal values.
+    // Whether the journal has edits for the feature, either because they were committed or because LoadJournal restored them.
+    bool HasFeature(const std::string& feature);
+    // The allocation is owned by the feature: it is journaled along with the feature's edits, and freed when the feature is removed.
+    void AddFeatureAllocation(const std::string& feature, uintptr_t address);
+    // Addresses of remote allocations which the journaled edits refer to, so that a restarted trainer can find them again.
+    // Like its allocations, a feature's values are forgotten when the feature is removed.
+    void SetJournalValue(const std::string& feature, const std::string& name, uint64_t value);
+    uint64_t GetJournalValue(const std::string& feature, const std::string& name);
+    // The journal is only valid for the process it was saved from. Loading it re-applies every enabled feature,
+    // and fails (without making any changes) if the process is different or the game code no longer matches.
+    bool SaveJournal(const std::wstring& path);
+    bool LoadJournal(const std::wstring& path);
+
+    void Intercept(PatchTransaction& patch, const std::string& name, __int64 firstLine, __int64 nextLine, const std::vector<byte>& data, bool writeOriginalCode = true);
+    void Unintercept(const std::string& name); // Removes the feature which owns the interception (see RemoveFeature)
     uintptr_t AllocateArray(__int64 size);
+    // Allocates within +/-2 GB of the target, so that it can be reached with a rel32 jump or call. Returns 0 on failure.
+    uintptr_t AllocateArrayNear(__int64 target, __int64 size);
+
+    struct FunctionCall {
+        __int64 address = 0;
+        __int64 rcx = 0;
+        __int64 rdx = 0;
+        __int64 r8 = 0;
+        __int64 r9 = 0;
+        float xmm0 = 0.0f;
+        float xmm1 = 0.0f;
+        float xmm2 = 0.0f;
+        float xmm3 = 0.0f;
+    };
+
+    // Function calls are executed by a single worker thread which lives inside the target process.
+    // Each future resolves to the full value of rax once the call has completed (or to 0 if the process went away).
+    // Submitting several calls at once only wakes the worker a single time.
+    std::vector<std::future<__int64>> CallFunctions(const std::vector<FunctionCall>& calls);
+    std::future<__int64> CallFunction(const FunctionCall& call) { return std::move(CallFunctions({call})[0]); }
 
     // This is the fully typed function -- you mostly won't need to call this.
-    int CallFunction(__int64 address,
+    std::future<__int64> CallFunction(__int64 address,
         const __int64 rcx, const __int64 rdx, const __int64 r8, const __int64 r9,
-        const float xmm0, const float xmm1, const float xmm2, const float xmm3);
-    int CallFunction(__int64 address, __int64 rcx) { return CallFunction(address, rcx, 0, 0, 0, 0.0f, 0.0f, 0.0f, 0.0f); }
-    int CallFunction(__int64 address, __int64 rcx, __int64 rdx, __int64 r8, __int64 r9) { return CallFunction(address, rcx, rdx, r8, r9, 0.0f, 0.0f, 0.0f, 0.0f); }
-    int CallFunction(__int64 address, __int64 rcx, const float xmm1) { return CallFunction(address, rcx, 0, 0, 0, 0.0f, xmm1, 0.0f, 0.0f); }
-    int CallFunction(__int64 address, const std::string& str, __int64 rdx);
+        const float xmm0, const float xmm1, const float xmm2, const float xmm3) { return CallFunction(FunctionCall{address, rcx, rdx, r8, r9, xmm0, xmm1, xmm2, xmm3}); }
+    std::future<__int64> CallFunction(__int64 address, __int64 rcx) { return CallFunction(address, rcx, 0, 0, 0, 0.0f, 0.0f, 0.0f, 0.0f); }
+    std::future<__int64> CallFunction(__int64 address, __int64 rcx, __int64 rdx, __int64 r8, __int64 r9) { return CallFunction(address, rcx, rdx, r8, r9, 0.0f, 0.0f, 0.0f, 0.0f); }
+    std::future<__int64> CallFunction(__int64 address, __int64 rcx, const float xmm1) { return CallFunction(address, rcx, 0, 0, 0, 0.0f, xmm1, 0.0f, 0.0f); }
+    std::future<__int64> CallFunction(__int64 address, const std::string& str, __int64 rdx);
 
 private:
-    void ReadDataInternal(void* buffer, const uintptr_t computedOffset, size_t bufferSize);
-    void WriteDataInternal(const void* buffer, uintptr_t computedOffset, size_t bufferSize);
+    // Both return the number of bytes transferred (which is at most the rest of the page), or 0 on failure.
+    size_t ReadDataInternal(void* buffer, const uintptr_t computedOffset, size_t bufferSize);
+    size_t WriteDataInternal(const void* buffer, uintptr_t computedOffset, size_t bufferSize);
     uintptr_t ComputeOffset(const std::vector<__int64>& offsets);
+    std::vector<byte> ReadAcrossPages(uintptr_t address, size_t size);
+    size_t ReadAcrossPages(void* buffer, uintptr_t address, size_t size); // Stops at the first page which fails, and returns the bytes read
+    // Reads the module's readable regions in chunks, and passes each one to onChunk (until it returns false). A reader thread keeps up to
+    // SCAN_BUFFERS chunks in flight, so that the next read overlaps with the current match. Each chunk is followed by up to SCAN_OVERLAP
+    // bytes of the next one, so that matches which start near the end of a chunk are still complete. Chunks are sized to their region.
+    // Our journaled edits are undone in each chunk, so that scans see the game's original code even while the edits are applied.
+    using ChunkFunc = std::function<bool(uintptr_t address, size_t chunkSize, const std::vector<byte>& data)>;
+    void ScanModule(const ChunkFunc& onChunk);
+    static constexpr size_t SCAN_BUFFERS = 3;
+    static constexpr size_t SCAN_OVERLAP = 0x100;
+    static constexpr size_t SCAN_MIN_CHUNK = 0x10000;
+    static constexpr size_t SCAN_MAX_CHUNK = 0x100000;
+    size_t WriteAcrossPages(const byte* buffer, uintptr_t address, size_t size); // Stops at the first page which fails, and returns the bytes written
+    bool ApplyEdits(const std::vector<std::pair<uintptr_t, std::vector<byte>>>& edits, bool largeEditsFirst); // All or nothing
+    static constexpr int s_guardReleaseAttempts = 3;
+    void StartRpcWorker();
+    uintptr_t FindModuleExport(const char* name); // Looks up an export of the module in the target process, or returns 0
+    void StopRpcWorker(bool processExited);
+    void CollectRpcResults();
 
     // Required for process attachment
     std::wstring _processName;
     std::wstring _moduleName;
-    HANDLE _handle = nullptr;
+    // The heartbeat closes the handle once the process exits, while command workers, attach steps and the RNG drain may still be using it.
+    // So every call which passes _handle to Windows holds _handleMutex shared (for just that call, since shared locks must not nest),
+    // and the close holds it exclusively.
+    std::atomic<HANDLE> _handle = nullptr;
+    std::shared_mutex _handleMutex;
+    HANDLE _launchingHandle = nullptr; // The process has been found, but the module is not loaded yet
+    std::shared_ptr<CancellationToken> _processToken = std::make_shared<CancellationToken>(true); // Replaced (atomically) on each attach
     DWORD _pid = 0;
     uintptr_t _baseAddress = 0;
     uintptr_t _endOfModule = 0;
@@ -107,24 +296,90 @@ private:
     HWND _hwnd = NULL;
 
     // Parts of Read / Write / Sigscan / etc
-    uintptr_t _functionPrimitive = 0;
     ThreadSafeAddressMap _computedAddresses;
 
+    // Remote function calls. The worker thread (in the target process) and the collector thread (in this process)
+    // communicate through a ring of request slots, each with its own completion state.
+    enum class RpcState : uint32_t {
+        Free = 0,
+        Pending = 1,
+        Done = 2,
+    };
+    struct RpcHeader {
+        uint64_t requestEvent; // Handle (valid in the target process) which wakes up the worker
+        uint64_t completionEvent; // Handle (valid in the target process) which wakes up the collector
+        uint64_t waitForSingleObject;
+        uint64_t setEvent;
+        uint64_t domainGet; // The module's il2cpp_domain_get, il2cpp_thread_attach and il2cpp_thread_detach (or 0 if it is not IL2CPP)
+        uint64_t threadAttach;
+        uint64_t threadDetach;
+        uint64_t il2cppThread; // Set by the worker, once it has attached
+        uint32_t quit;
+        uint32_t padding;
+    };
+    struct RpcSlot {
+        uint64_t address;
+        int64_t rcx;
+        int64_t rdx;
+        int64_t r8;
+        int64_t r9;
+        float xmm0;
+        float xmm1;
+        float xmm2;
+        float xmm3;
+        int64_t result;
+        RpcState state;
+        uint32_t padding;
+    };
+    static constexpr int RPC_SLOTS = 16;
+    uintptr_t _rpcBlock = 0; // [RpcHeader, RpcSlot * RPC_SLOTS, worker code]
+    HANDLE _rpcThread = nullptr;
+    HANDLE _rpcRequestEvent = nullptr;
+    HANDLE _rpcCompletionEvent = nullptr;
+    std::thread _rpcCollector;
+    std::mutex _rpcMutex;
+    std::condition_variable _rpcSlotFreed;
+    std::optional<std::promise<__int64>> _rpcPromises[RPC_SLOTS]; // Engaged while the slot is in use
+    bool _rpcActive = false;
+    // If the worker can't be started, we wait before trying again (doubling the wait each time), rather than retrying on every call.
+    static constexpr std::chrono::milliseconds s_rpcMinBackoff{500};
+    static constexpr std::chrono::milliseconds s_rpcMaxBackoff{30'000};
+    std::chrono::milliseconds _rpcBackoff = s_rpcMinBackoff;
+    std::chrono::steady_clock::time_point _rpcNextStart;
+
+    // Helper functions (run by the RPC worker) which perform atomic stores into game code.
+    uintptr_t _patchHelpers = 0; // [Exchange16, Exchange2]
+
     struct SigScan {
-        bool found = false;
-        std::string hex;
+        uint64_t id;
+        SigScanScope scope;
+        bool found = false; // For AddSigScanAll, whether the scan has been run
+        bool findAll = false;
         std::vector<byte> bytes;
-        ScanFunc2 scanFunc;
+        std::vector<byte> mask; // Empty if every byte must match
+        ScanFunc scanFunc;
+        std::shared_ptr<SigScanHandle::Result> result; // Shared with the handle
 
-        static std::vector<byte> GetScanBytes(const std::string& scanHex);
+        std::string ToString() const;
     };
+    SigScanHandle AddSigScanInternal(SigScan&& sigScan);
+    void RemoveSigScan(uint64_t id);
+    std::mutex _sigScanMutex; // Sigscans are added (and removed) by the attach steps while other steps may be running
+    uint64_t _nextSigScanId = 1;
     std::vector<SigScan> _sigScans;
 
-    struct Interception {
-        std::string name;
-        int64_t firstLine;
-        std::vector<byte> replacedCode;
-        uintptr_t addr;
+    struct JournalEntry {
+        std::string feature;
+        uintptr_t address;
+        std::vector<byte> originalBytes;
+        std::vector<byte> newBytes;
     };
-    std::vector<Interception> _interceptions;
+    uint64_t GetProcessCreationTime();
+    bool ApplyJournal(const std::string& feature); // Brings the code in line with _featureEnabled (for one feature, or all if empty). Requires _journalMutex.
+    std::mutex _journalMutex;
+    std::vector<JournalEntry> _journal;
+    std::map<std::string, bool> _featureEnabled;
+    std::map<std::string, std::map<std::string, uint64_t>> _journalValues; // [feature][name]
+    std::map<std::string, std::vector<uintptr_t>> _featureAllocations;
+    void FreeAllocations(const std::vector<uintptr_t>& allocations); // After the edits which refer to them are reverted. Requires _journalMutex.
 };
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include "pch.h"
+#include "RngLog.h"
+#include <filesystem>
+
+#define RNG_LOG_MAGIC "BPRL\x01" // Bump the last byte if the encoding changes
+
+namespace {
+    uint32_t ZigZag(int32_t value) { return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31); }
+    int32_t UnZigZag(uint32_t value) { return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1); }
+
+    void WriteVarint(std::vector<byte>& buffer, uint32_t value) {
+        while (value >= 0x80) {
+            buffer.push_back(static_cast<byte>(value | 0x80));
+            value >>= 7;
+        }
+        buffer.push_back(static_cast<byte>(value));
+    }
+
+    bool ReadVarint(const std::vector<byte>& data, size_t& position, uint32_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (position >= data.size()) return false;
+            byte b = data[position++];
+            value |= static_cast<uint32_t>(b & 0x7F) << shift;
+            if ((b & 0x80) == 0) return true;
+        }
+        return false;
+    }
+}
+
+bool RngLogWriter::Open(const std::wstring& path) {
+    Close();
+    _file.open(std::filesystem::path(path), std::ios::binary | std::ios::trunc);
+    if (!_file) return false;
+    _file.write(RNG_LOG_MAGIC, sizeof(RNG_LOG_MAGIC) - 1);
+    _previousRange.clear();
+    return _file.good();
+}
+
+void RngLogWriter::Append(const RngDraw& draw) {
+    auto& [previousMin, previousMax] = _previousRange[draw.callSite]; // Call sites usually ask for the same range every time
+    _buffer.push_back(draw.rngClass);
+    WriteVarint(_buffer, draw.callSite);
+    WriteVarint(_buffer, ZigZag(static_cast<int32_t>(draw.min - previousMin)));
+    WriteVarint(_buffer, ZigZag(static_cast<int32_t>(draw.max - previousMax)));
+    WriteVarint(_buffer, ZigZag(static_cast<int32_t>(draw.value - draw.min)));
+    previousMin = draw.min;
+    previousMax = draw.max;
+}
+
+void RngLogWriter::Flush() {
+    if (!_file.is_open() || _buffer.empty()) return;
+    _file.write(reinterpret_cast<const char*>(_buffer.data()), _buffer.size());
+    _file.flush();
+    _buffer.clear();
+}
+
+void RngLogWriter::Close() {
+    Flush();
+    if (_file.is_open()) _file.close();
+}
+
+bool RngLogReader::Open(const std::wstring& path) {
+    std::ifstream file(std::filesystem::path(path), std::ios::binary | std::ios::ate);
+    if (!file) return false;
+    _data.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(_data.data()), _data.size());
+    if (!file) return false;
+
+    _position = sizeof(RNG_LOG_MAGIC) - 1;
+    _previousRange.clear();
+    return _data.size() >= _position && std::equal(_data.begin(), _data.begin() + _position, RNG_LOG_MAGIC);
+}
+
+bool RngLogReader::Next(RngDraw& draw) {
+    if (_position >= _data.size()) return false;
+    draw.rngClass = _data[_position++];
+
+    uint32_t callSite, minDelta, maxDelta, valueDelta;
+    if (!ReadVarint(_data, _position, callSite)) return false;
+    if (!ReadVarint(_data, _position, minDelta)) return false;
+    if (!ReadVarint(_data, _position, maxDelta)) return false;
+    if (!ReadVarint(_data, _position, valueDelta)) return false;
+
+    auto& [previousMin, previousMax] = _previousRange[static_cast<uint16_t>(callSite)];
+    draw.callSite = static_cast<uint16_t>(callSite);
+    draw.min = previousMin + UnZigZag(minDelta);
+    draw.max = previousMax + UnZigZag(maxDelta);
+    draw.value = draw.min + UnZigZag(valueDelta);
+    previousMin = draw.min;
+    previousMax = draw.max;
+    return true;
+}
+
+int64_t DiffRngLogs(const std::wstring& pathA, const std::wstring& pathB, const std::vector<byte>& rngClasses) {
+    RngLogReader a, b;
+    if (!a.Open(pathA) || !b.Open(pathB)) return -2;
+
+    bool compared[0x100] = {};
+    for (byte rngClass : rngClasses) compared[rngClass] = true;
+    auto nextCompared = [&compared](RngLogReader& reader, RngDraw& draw) {
+        while (reader.Next(draw)) {
+            if (compared[draw.rngClass]) return true;
+        }
+        return false;
+    };
+
+    RngDraw drawA, drawB;
+    for (int64_t i = 0;; i++) {
+        bool hasA = nextCompared(a, drawA);
+        bool hasB = nextCompared(b, drawB);
+        if (!hasA && !hasB) return -1;
+        if (hasA != hasB || drawA != drawB) return i;
+    }
+}
+
+#undef RNG_LOG_MAGIC
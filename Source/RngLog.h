@@ -0,0 +1,49 @@
+#pragma once
+#include <fstream>
+#include <unordered_map>
+
+// A compact binary log of the RNG draws made by our injected kernels, used to check that two runs produced identical random streams.
+// Each draw is stored as its class, followed by varints for the call site, the range (as deltas from the previous draw at the same call site),
+// and the value (as a delta from the lower limit). Float draws are stored bitwise.
+struct RngDraw {
+    byte rngClass = 0;
+    uint16_t callSite = 0; // Index into the RNG sigscans, or s_unknownCallSite
+    uint32_t min = 0;
+    uint32_t max = 0;
+    uint32_t value = 0;
+
+    static constexpr uint16_t s_unknownCallSite = 0xFFFF;
+    bool operator==(const RngDraw& other) const {
+        return rngClass == other.rngClass && callSite == other.callSite && min == other.min && max == other.max && value == other.value;
+    }
+    bool operator!=(const RngDraw& other) const { return !(*this == other); }
+};
+
+class RngLogWriter final {
+public:
+    bool Open(const std::wstring& path);
+    bool IsOpen() const { return _file.is_open(); }
+    void Append(const RngDraw& draw);
+    void Flush(); // Draws are buffered until the next flush.
+    void Close();
+
+private:
+    std::ofstream _file;
+    std::vector<byte> _buffer;
+    std::unordered_map<uint16_t, std::pair<uint32_t, uint32_t>> _previousRange;
+};
+
+class RngLogReader final {
+public:
+    bool Open(const std::wstring& path);
+    bool Next(RngDraw& draw); // Returns false at the end of the log (or if the log is truncated).
+
+private:
+    std::vector<byte> _data;
+    size_t _position = 0;
+    std::unordered_map<uint16_t, std::pair<uint32_t, uint32_t>> _previousRange;
+};
+
+// Compares the draws of the given classes in two logs, ignoring all other draws.
+// Returns the index (among the compared draws) of the first difference, or -1 if the streams are identical. Returns -2 if either log can't be read.
+int64_t DiffRngLogs(const std::wstring& pathA, const std::wstring& pathB, const std::vector<byte>& rngClasses);
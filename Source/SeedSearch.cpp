@@ -0,0 +1,106 @@
+// Not using pch.h, so that this builds without Windows. See SeedSearch.h.
+#include "SeedSearch.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+float RngEmulator::ReduceFloat(uint64_t random, float minInclusive, float maxInclusive) {
+    // Each step is a separate single-precision operation, in the same order as the kernel. This file must not be compiled with FMA contraction.
+    uint32_t bits = static_cast<uint32_t>(random >> 41) | 0x3F800000;
+    float unit;
+    memcpy(&unit, &bits, sizeof(unit));
+    unit -= 1.0f;
+    float range = maxInclusive - minInclusive;
+    float scaled = unit * range;
+    return scaled + minInclusive;
+}
+
+bool SeedSearch::Result::operator<(const Result& other) const {
+    if (satisfied != other.satisfied) return satisfied > other.satisfied;
+    if (prefix != other.prefix) return prefix > other.prefix;
+    return seed < other.seed;
+}
+
+std::vector<SeedSearch::Result> SeedSearch::Run(const Query& query) {
+    std::vector<CompiledConstraint> constraints;
+    for (const auto& draw : query.draws) {
+        CompiledConstraint constraint = {draw.minInclusive, draw.maxExclusive, draw.allowed.empty(), {}};
+        uint32_t range = static_cast<uint32_t>(draw.maxExclusive - draw.minInclusive);
+        constraint.allowedBits.resize(range / 64 + 1, 0);
+        for (int32_t value : draw.allowed) {
+            uint32_t index = static_cast<uint32_t>(value - draw.minInclusive);
+            if (index < range || (range == 0 && index == 0)) constraint.allowedBits[index / 64] |= 1ull << (index % 64);
+        }
+        constraints.push_back(std::move(constraint));
+    }
+
+    unsigned numThreads = query.threads;
+    if (numThreads == 0) numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Each thread claims tasks of s_seedsPerTask seeds, and keeps its own best results.
+    uint64_t numTasks = (query.seedCount + s_seedsPerTask - 1) / s_seedsPerTask;
+    std::atomic<uint64_t> nextTask = 0;
+    std::vector<std::vector<Result>> threadResults(numThreads);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < numThreads; i++) {
+        threads.emplace_back([&, i] {
+            for (uint64_t task = nextTask++; task < numTasks; task = nextTask++) {
+                uint64_t offset = task * s_seedsPerTask;
+                SearchRange(constraints, query, query.firstSeed + offset, std::min(s_seedsPerTask, query.seedCount - offset), threadResults[i]);
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    std::vector<Result> results;
+    for (const auto& threadResult : threadResults) results.insert(results.end(), threadResult.begin(), threadResult.end());
+    KeepBest(results, query.maxResults);
+    return results;
+}
+
+void SeedSearch::SearchRange(const std::vector<CompiledConstraint>& constraints, const Query& query, uint64_t firstSeed, uint64_t count, std::vector<Result>& results) {
+    for (uint64_t block = 0; block < count; block += s_lanes) {
+        // The lanes are kept in plain arrays, and every loop over them is branch-free, so that they vectorize.
+        uint64_t state[s_lanes];
+        uint32_t satisfied[s_lanes] = {};
+        uint32_t prefix[s_lanes] = {};
+        uint32_t inPrefix[s_lanes];
+        for (int lane = 0; lane < s_lanes; lane++) {
+            state[lane] = firstSeed + block + lane;
+            inPrefix[lane] = 1;
+        }
+
+        for (const auto& constraint : constraints) {
+            uint32_t hit[s_lanes];
+            uint32_t anyHit = 0;
+            for (int lane = 0; lane < s_lanes; lane++) {
+                state[lane] += RngEmulator::s_gamma;
+                uint64_t random = RngEmulator::Mix(state[lane]);
+                uint32_t index = static_cast<uint32_t>(RngEmulator::ReduceInt(random, constraint.minInclusive, constraint.maxExclusive) - constraint.minInclusive);
+                hit[lane] = constraint.any | static_cast<uint32_t>((constraint.allowedBits[index / 64] >> (index % 64)) & 1);
+                satisfied[lane] += hit[lane];
+                inPrefix[lane] &= hit[lane];
+                prefix[lane] += inPrefix[lane];
+                anyHit |= inPrefix[lane];
+            }
+            // If every lane has already failed a constraint, none of them can be a full match.
+            if (query.requireAll && anyHit == 0) break;
+        }
+
+        for (int lane = 0; lane < s_lanes && block + lane < count; lane++) {
+            if (query.requireAll && satisfied[lane] != constraints.size()) continue;
+            if (satisfied[lane] == 0) continue;
+            results.push_back({firstSeed + block + lane, satisfied[lane], prefix[lane]});
+        }
+        if (results.size() > 2 * query.maxResults + 1024) KeepBest(results, query.maxResults);
+    }
+}
+
+void SeedSearch::KeepBest(std::vector<Result>& results, size_t maxResults) {
+    if (results.size() > maxResults) {
+        std::nth_element(results.begin(), results.begin() + maxResults, results.end());
+        results.resize(maxResults);
+    }
+    std::sort(results.begin(), results.end());
+}
@@ -0,0 +1,78 @@
+#pragma once
+// This file is deliberately free of Windows (and trainer) dependencies, so that seed searches can run headless on Linux.
+// See Tools/SeedSearch/Main.cpp.
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// An exact emulation of the injected RNG kernels (see Trainer::InjectCustomRng) for a single RngClass using RngBehavior::Randomize.
+class RngEmulator final {
+public:
+    static constexpr uint64_t s_rngAlgorithm = 3; // Must match Trainer::s_rngAlgorithm
+
+    RngEmulator(uint64_t seed) : _state(seed) {}
+    int32_t NextInt(int32_t minInclusive, int32_t maxExclusive) { return ReduceInt(Advance(), minInclusive, maxExclusive); }
+    float NextFloat(float minInclusive, float maxInclusive) { return ReduceFloat(Advance(), minInclusive, maxInclusive); }
+    float NextValue() { return NextFloat(0.0f, 1.0f); }
+
+    // splitmix64
+    static constexpr uint64_t s_gamma = 0x9E3779B97F4A7C15;
+    static uint64_t Mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+        return z ^ (z >> 31);
+    }
+    // Lemire's multiply-shift, on the top 32 bits
+    static int32_t ReduceInt(uint64_t random, int32_t minInclusive, int32_t maxExclusive) {
+        uint64_t range = static_cast<uint32_t>(maxExclusive - minInclusive);
+        return static_cast<int32_t>(static_cast<uint32_t>(minInclusive) + static_cast<uint32_t>(((random >> 32) * range) >> 32));
+    }
+    static float ReduceFloat(uint64_t random, float minInclusive, float maxInclusive);
+
+private:
+    uint64_t Advance() { _state += s_gamma; return Mix(_state); }
+    uint64_t _state;
+};
+
+// Searches for seeds whose first few draws (in one RngClass) satisfy a list of constraints.
+// Draw i of a seed is the i'th call to Random.Range(min, max) in that class, after the seed was set with Trainer::SetSeed.
+class SeedSearch final {
+public:
+    struct DrawConstraint {
+        int32_t minInclusive = 0;
+        int32_t maxExclusive = 0;
+        std::vector<int32_t> allowed; // The draw must return one of these values. If empty, any value is allowed (the draw just advances the stream).
+    };
+
+    struct Query {
+        std::vector<DrawConstraint> draws;
+        uint64_t firstSeed = 1;
+        uint64_t seedCount = 1'000'000;
+        size_t maxResults = 10;
+        bool requireAll = true; // Only return seeds which satisfy every constraint. Much faster, since most seeds are rejected after a draw or two.
+        unsigned threads = 0; // 0 to use every core
+    };
+
+    struct Result {
+        uint64_t seed;
+        uint32_t satisfied; // How many constraints this seed satisfies
+        uint32_t prefix; // How many leading constraints this seed satisfies
+        bool operator<(const Result& other) const; // Better results sort first
+    };
+
+    // Returns the best matching seeds, best first.
+    static std::vector<Result> Run(const Query& query);
+
+private:
+    static constexpr int s_lanes = 8; // Seeds are evaluated in blocks of this many lanes, which the compiler turns into SIMD.
+    static constexpr uint64_t s_seedsPerTask = 1 << 16;
+
+    struct CompiledConstraint {
+        int32_t minInclusive;
+        int32_t maxExclusive;
+        bool any;
+        std::vector<uint64_t> allowedBits; // Bitmap over [0, max - min)
+    };
+    static void SearchRange(const std::vector<CompiledConstraint>& constraints, const Query& query, uint64_t firstSeed, uint64_t count, std::vector<Result>& results);
+    static void KeepBest(std::vector<Result>& results, size_t maxResults);
+};
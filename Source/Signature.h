@@ -0,0 +1,47 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+
+// A sigscan pattern, written as space-separated hex bytes: SIG("48 8B ?? C1 20"). '??' matches any byte.
+// SIG parses the pattern into a constexpr variable, so the compiler always parses it, and malformed hex (which throws) is a compile error.
+// Signatures should only be made through SIG; a runtime Signature with bad hex would terminate instead.
+#define SIG(hex) ([] { constexpr Signature signature(hex, sizeof(hex) - 1); return signature; }())
+
+class Signature final {
+public:
+    static constexpr size_t s_maxSize = 0x20;
+
+    constexpr Signature(const char* hex, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            if (hex[i] == ' ') continue;
+            if (i + 1 >= length || hex[i + 1] == ' ') throw std::invalid_argument("Signature bytes must be two hex digits");
+            if (i + 2 < length && hex[i + 2] != ' ') throw std::invalid_argument("Signature bytes must be separated by spaces");
+            if (_size >= s_maxSize) throw std::length_error("Signature is too long");
+            if (hex[i] == '?' && hex[i + 1] == '?') {
+                _mask[_size++] = 0x00;
+            } else {
+                _bytes[_size] = static_cast<uint8_t>(Nibble(hex[i]) * 0x10 + Nibble(hex[i + 1]));
+                _mask[_size++] = 0xFF;
+            }
+            i++;
+        }
+        if (_size == 0) throw std::invalid_argument("Signature is empty");
+    }
+
+    constexpr size_t Size() const { return _size; }
+    constexpr const uint8_t* Bytes() const { return _bytes.data(); }
+    constexpr const uint8_t* Mask() const { return _mask.data(); } // 0xFF for each byte which must match, 0x00 for wildcards
+
+private:
+    static constexpr int Nibble(char ch) {
+        if (ch >= '0' && ch <= '9') return ch - '0';
+        if (ch >= 'A' && ch <= 'F') return ch - 'A' + 0xA;
+        if (ch >= 'a' && ch <= 'f') return ch - 'a' + 0xA;
+        throw std::invalid_argument("Signature contains a character which is not hex");
+    }
+
+    std::array<uint8_t, s_maxSize> _bytes = {};
+    std::array<uint8_t, s_maxSize> _mask = {};
+    size_t _size = 0;
+};
@@ -1,52 +1,90 @@
 #include "pch.h"
 #include "Trainer.h"
 #include "Panels.h"
+#include "SeedSearch.h"
+#include "AttachPipeline.h"
+#include <filesystem>
+
+namespace {
+    // The IL2CPP internal calls which reach the RNG. The kernel for each one is picked in RedirectIcallRngSlots.
+    const char* s_rngIcalls[] = {
+        "UnityEngine.Random::RandomRangeInt(System.Int32,System.Int32)",
+        "UnityEngine.Random::Range(System.Single,System.Single)",
+        "UnityEngine.Random::get_value()",
+    };
+
+    // Files which the trainer writes are kept next to its executable, rather than in whatever the working directory happens to be.
+    std::filesystem::path GetDataPath(const wchar_t* name) {
+        wchar_t executable[MAX_PATH];
+        DWORD length = GetModuleFileNameW(NULL, executable, MAX_PATH);
+        return std::filesystem::path(std::wstring(executable, length)).parent_path() / name;
+    }
+}
 
 Trainer::Trainer(std::shared_ptr<Memory> memory) : _memory(memory) {
+    _deckDecoder.SetOnDeck([this](size_t slot, const DeckDecoder::Deck& deck) { RecordDraft(slot, deck); });
+    _heartbeatStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
 }
 
 void Trainer::StartHeartbeat(HWND window, UINT message) {
     if (_threadActive) return;
     _threadActive = true;
+    ResetEvent(_heartbeatStopEvent);
     _thread = std::thread([sharedThis = shared_from_this(), window, message]{
         SetCurrentThreadName(L"Heartbeat");
 
+        std::optional<ProcStatus> previousStatus;
+        std::chrono::milliseconds interval = s_heartbeat;
         do {
             ProcStatus status = sharedThis->Heartbeat();
             sharedThis->_firstHeartbeat = false;
 
-            PostMessage(window, message, status, NULL);
-            std::this_thread::sleep_for(s_heartbeat);
+            // Only transitions are interesting to the UI; the steady states would just repeat themselves.
+            if (status != previousStatus) PostMessage(window, message, status, NULL);
+            previousStatus = status;
+
+            // While the game isn't running at all, back off, since each attempt to find it takes a process snapshot.
+            // Once it has been found, the wait ends as soon as the process exits, so the interval only limits how often we poll it.
+            if (sharedThis->_memory->IsProcessFound()) interval = s_heartbeat;
+            else interval = std::min(interval * 2, s_idleHeartbeat);
+            sharedThis->_memory->WaitForProcessEvent(interval, sharedThis->_heartbeatStopEvent);
         } while (sharedThis->_threadActive);
         });
     _thread.detach();
 }
 
+void Trainer::StopHeartbeat() {
+    _threadActive = false;
+    SetEvent(_heartbeatStopEvent);
+}
+
 ProcStatus Trainer::Heartbeat() {
     ProcStatus memoryStatus = _memory->TryAttachToProcess();
     if (memoryStatus == ProcStatus::NotRunning) return ProcStatus::NotRunning;
     if (memoryStatus == ProcStatus::Stopped) {
         _gameWasStarted = false; // Used to detect if the game just started
-        // Wait for the process to fully close; otherwise we might accidentally re-attach to it.
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+        {
+            std::lock_guard<std::mutex> l(_rngRecordMutex);
+            _rngLog.Close(); // The ring went away with the game, so there is nothing left to drain.
+        }
         return ProcStatus::Stopped;
     }
 
-    // Note that sigscans are idempotent -- each should only "succeed" once.
-    // Ergo, it is OK to have sigscans which are not available until after a few game actions are taken.
-    size_t failedScans = _memory->ExecuteSigScans();
-    if (failedScans > 0) return ProcStatus::NotRunning;
+    // Sigscans are run by the attach (once, for every feature at once), not by the heartbeat.
 
     // TODO: No concept of loading as yet.
 
     // At this point, we think the game is running... now we have to figure out what, exactly, to say.
 
+    // The attach is for the process we just saw, so it takes that process's token now. If the game exits (and another starts) before the attach gets going,
+    // the attach sees a cancelled token, rather than the new process's.
+
     // If this is the first heartbeat we're sending, we just started (and the game was already running).
     // We set _firstHeartbeat = false in the caller after we return.
     if (_firstHeartbeat) {
         _gameWasStarted = true;
-        std::thread([sharedThis = shared_from_this()] {
-            sharedThis->OnGameStart();
+        std::thread([sharedThis = shared_from_this(), token = _memory->GetProcessToken()] {
+            sharedThis->OnGameStart(token);
         }).detach();
         return ProcStatus::AlreadyRunning;
     }
@@ -54,318 +92,619 @@ ProcStatus Trainer::Heartbeat() {
     // If this is the first heartbeat where the Entity_Manager is allocated, the game just started
     if (!_gameWasStarted) {
         _gameWasStarted = true;
-        std::thread([sharedThis = shared_from_this()] {
-            Sleep(0x1000); // Slight delay since (apparently) the loading status is 0 even though the game isn't quite ready.
-            sharedThis->OnGameStart();
+        std::thread([sharedThis = shared_from_this(), token = _memory->GetProcessToken()] {
+            if (token->WaitFor(s_startupDelay)) return; // The game exited during the delay
+            sharedThis->OnGameStart(token);
         }).detach();
         return ProcStatus::Started;
     }
 
     // Otherwise, business as usual.
+    {
+        std::lock_guard<std::mutex> l(_rngRecordMutex);
+        DrainRngRecording();
+    }
+    ResolveRoomTemplates();
     return ProcStatus::Running;
 }
 
-void Trainer::OnGameStart() {
-#if DERANDOMIZE
-    FindAllRngFunctions();
+void Trainer::OnGameStart(const std::shared_ptr<const CancellationToken>& token) {
+    {
+        std::lock_guard<std::mutex> l(_decksMutex);
+        _deckDecoder.Reset(); // The decoder refers to the cached names
+        _roomNames.clear(); // Template addresses are only valid within one run of the game
 
-    InjectCustomRng();
-    OverwriteRngFunctions();
+        // Each game session gets its own history store, named after the time it started.
+        std::time_t now = std::time(nullptr);
+        std::tm localTime;
+        localtime_s(&localTime, &now);
+        std::wostringstream name;
+        name << std::put_time(&localTime, L"%Y%m%d-%H%M%S");
+        const std::wstring directory = (GetDataPath(s_draftHistoryDirectory) / name.str()).wstring();
+        if (!_draftHistory.Open(directory)) DebugPrint(L"Failed to open draft history: " + directory);
+    }
+    {
+        std::lock_guard<std::mutex> l(_roomTemplatesMutex);
+        _roomTemplates.clear();
+    }
+
+    // If a previous trainer already patched this process (and didn't get to clean up), its edits and allocations are restored from the journal.
+    // A restored feature skips its allocate and assemble steps, but it still scans and resolves, since the trainer needs those results as well.
+    // The scans see the original game code, so they still match. See Memory::ScanModule
+    const std::wstring journalPath = GetDataPath(s_journalFile).wstring();
+    _memory->LoadJournal(journalPath);
 
-    g_trainer->SetAllSeeds(42); // A seed value of 0 will stay stuck at 0, I think.
-    g_trainer->SetAllBehaviors(Trainer::RngBehavior::Constant);
+    // Each feature is split into stages, which run in parallel with the same stage of the other features. See AttachPipeline.h
+    // Every feature declares its sigscans up front, so that the pipeline can find all of them in a single pass over the module.
+    AttachPipeline pipeline;
+#if DERANDOMIZE
+    pipeline.AddStep("Derandomize", AttachPipeline::Declare, [this](Memory::PatchTransaction&) {
+        DeclareRngScans();
+        return true;
+    });
+    pipeline.AddStep("Derandomize", AttachPipeline::Resolve, [this](Memory::PatchTransaction&) {
+        if (!ResolveRngFunctions()) return false;
+        FindIcallRngSlots();
+        ClassifyIcallRngCallers();
+        return true;
+    });
+    if (_memory->HasFeature("Derandomize")) {
+        pipeline.AddStep("Derandomize", AttachPipeline::Allocate, [this](Memory::PatchTransaction&) { return RestoreCustomRng(); });
+    } else {
+        pipeline.AddStep("Derandomize", AttachPipeline::Allocate, [this](Memory::PatchTransaction&) {
+            InjectCustomRng();
+            return _rngSeedArray != 0 && _intRngFunction != 0 && _floatRngFunction != 0;
+        });
+        pipeline.AddStep("Derandomize", AttachPipeline::Assemble, [this](Memory::PatchTransaction& patch) {
+            OverwriteRngFunctions(patch);
+            RedirectIcallRngSlots(patch);
+            SetAllSeeds(42); // A seed value of 0 will stay stuck at 0, I think.
+            SetAllBehaviors(RngBehavior::Constant);
+            return true;
+        });
+    }
 #endif
 
-    InjectDraftWatcher();
-    HookFsmInt();
+    pipeline.AddStep("PickRoomFromSlot", AttachPipeline::Declare, [this](Memory::PatchTransaction&) {
+        DeclareDraftWatcherScans();
+        return true;
+    });
+    pipeline.AddStep("PickRoomFromSlot", AttachPipeline::Resolve, [this](Memory::PatchTransaction&) { return ResolveDraftWatcher(); });
+    if (_memory->HasFeature("PickRoomFromSlot")) {
+        pipeline.AddStep("PickRoomFromSlot", AttachPipeline::Allocate, [this](Memory::PatchTransaction&) { return RestoreDraftWatcher(); });
+    } else {
+        pipeline.AddStep("PickRoomFromSlot", AttachPipeline::Allocate, [this](Memory::PatchTransaction&) {
+            AllocateDraftBuffer();
+            WriteRoomNameTable();
+            return _buffer != 0;
+        });
+        pipeline.AddStep("PickRoomFromSlot", AttachPipeline::Assemble, [this](Memory::PatchTransaction& patch) {
+            InjectDraftWatcher(patch);
+            return true;
+        });
+    }
+
+    pipeline.AddStep("SetIntValue", AttachPipeline::Declare, [this](Memory::PatchTransaction&) {
+        DeclareFsmIntScans();
+        return true;
+    });
+    pipeline.AddStep("SetIntValue", AttachPipeline::Resolve, [this](Memory::PatchTransaction&) { return ResolveFsmInt(); });
+    if (!_memory->HasFeature("SetIntValue")) {
+        pipeline.AddStep("SetIntValue", AttachPipeline::Assemble, [this](Memory::PatchTransaction& patch) {
+            HookFsmInt(patch);
+            return true;
+        });
+    }
+
+    // If the game exits partway through, nothing is committed (and there is no point in saving a journal for it).
+    if (!pipeline.Run(*_memory, *token)) return;
+    // A feature which failed was removed along with its allocations, so we must stop using them. It is left out of the journal, to be retried next time.
+#if DERANDOMIZE
+    if (!_memory->HasFeature("Derandomize")) _rngSeedArray = _rngBehaviors = _rngRecordRing = _intRngFunction = _floatRngFunction = 0;
+#endif
+    if (!_memory->HasFeature("PickRoomFromSlot")) _buffer = _roomNameTable = 0;
+    _memory->SaveJournal(journalPath);
 }
 
 // Restore default game settings when shutting down the trainer.
 Trainer::~Trainer() {
-    _memory->Unintercept("PickRoomFromSlot");
-    _memory->Unintercept("SetIntValue");
-#if DERANDOMIZE
-    #error TODO: Undo OverwriteRngFunctions
-#endif
+    StopRngRecording();
+    {
+        std::lock_guard<std::mutex> l(_decksMutex);
+        _draftHistory.Close();
+    }
+
+    // Restore every edit we made to game code as a single unit, then free our allocations (trampolines, buffers).
+    // This leaves nothing for the journal to restore; it is only needed if the trainer exits without getting here.
+    _memory->RemoveAllFeatures();
+    _memory->SaveJournal(GetDataPath(s_journalFile).wstring());
 
     StopHeartbeat();
     if (_thread.joinable()) _thread.join();
+    CloseHandle(_heartbeatStopEvent);
 }
 
 void Trainer::InjectCustomRng() {
-    _rngSeedArray = _memory->AllocateArray(RngClass::NumEntries * sizeof(__int64));
+    // The seeds share an allocation with the call counters: [seeds, class counters, call site counters, record flag, call site stubs].
+    // Each call site gets a stub which counts the call and then jumps to the shim for its category; the stubs are reached
+    // with a rel32 from the game code, so we try to allocate them near the module. Otherwise, only the classes are counted.
+    _numRngCallSites = _sigScans1.size() + _sigScans2.size() + _sigScans3.size();
+    __int64 stubsOffset = (2 * RngClass::NumEntries + _numRngCallSites + 1) * sizeof(__int64);
+    __int64 rngBlockSize = stubsOffset + _numRngCallSites * s_callSiteStubSize;
+    _rngSeedArray = _memory->AllocateArrayNear(_sigScans2[0].targetFunction, rngBlockSize);
+    bool callSiteStubsReachable = (_rngSeedArray != 0);
+    if (!callSiteStubsReachable) _rngSeedArray = _memory->AllocateArray(rngBlockSize);
     _rngBehaviors = _memory->AllocateArray(RngClass::NumEntries * sizeof(byte));
+    _rngRecordRing = _memory->AllocateArray(s_rngRecordHeaderSize + s_rngRecordCapacity * sizeof(RngRecordEntry));
+    for (__int64 allocation : {_rngSeedArray, _rngBehaviors, _rngRecordRing}) _memory->AddFeatureAllocation("Derandomize", allocation);
+    _memory->SetJournalValue("Derandomize", "RngSeedArray", _rngSeedArray);
+    _memory->SetJournalValue("Derandomize", "RngBehaviors", _rngBehaviors);
+    _memory->SetJournalValue("Derandomize", "RngCallSites", _numRngCallSites);
+    _memory->SetJournalValue("Derandomize", "RngRecordRing", _rngRecordRing);
+    MapRngCallSites();
+
+    if (callSiteStubsReachable) {
+        std::vector<byte> stubs;
+        __int64 siteIndex = 0;
+        for (auto* sigScans : {&_sigScans1, &_sigScans2, &_sigScans3}) {
+            for (auto& sigScan : *sigScans) {
+                sigScan.callSiteStub = _rngSeedArray + stubsOffset + stubs.size();
+                __int64 counter = GetRngCallSiteCounters() + siteIndex * sizeof(__int64);
+                __int64 classEntry = sigScan.targetFunction + 5 * sigScan.rngClass;
+                stubs.insert(stubs.end(), {
+                    0x48, 0xFF, 0x05, INT_TO_BYTES(counter - (sigScan.callSiteStub + 7)),      // inc qword ptr [rip + counter]    ; Count this call
+                    0xE9, INT_TO_BYTES(classEntry - (sigScan.callSiteStub + 12)),              // jmp classEntry                   ; Continue into the 'mov r8b, rngClass' for its category
+                    0xCC, 0xCC, 0xCC, 0xCC,                                                     // int 3                            ; (padding)
+                });
+                siteIndex++;
+            }
+        }
+        assert(stubs.size() == _numRngCallSites * s_callSiteStubSize, "[INTERNAL ERROR] Call site stubs were resized without updating s_callSiteStubSize");
+        size_t written = _memory->WriteDataAcrossPages<byte>({_rngSeedArray + stubsOffset}, stubs);
+        assert(written == stubs.size(), "Failed to write the RNG call site stubs");
+    }
 
     // Each category has its own seed value.
     // Each category also has its own "behavior", which is one of these cases:
     // - Case 1: Return the seed value, unchanged
     // - Case 2: Return the seed value, then increment the seed value
-    // - Case 3: Return the seed value, then PRNG shuffle the seed value
-    // The PRNG is adapted from MSVC's type_traits hashing implementation, see:
-    // https://github.com/microsoft/STL/blob/main/stl/inc/type_traits#L2407
-    std::vector<byte> intRngInstructions = {
-        0x56,                                                   // push rsi                         ; Preserve the values of rsi and rdi (we will use them as scratch registers)
-        0x57,                                                   // push rdi                         ;
-        0x48, 0x31, 0xC0,                                       // xor rax, rax                     ; Reset the return value to 0 (just in case)
-        0x4D, 0x0F, 0xB6, 0xC0,                                 // movzx r8, r8b                    ; Clear any high bits on r8 (we used r8b to save our "category")
-        0x48, 0xBE, LONG_TO_BYTES(_rngBehaviors),               // mov rsi, _rngBehaviors           ; Load in the lookup table
-        IF_EQ(0x42, 0x80, 0x3C, 0x06, RngBehavior::Constant),   // cmp byte ptr [rsi + r8], 1       ; If this RNG category is using type 1 (fixed value)
-        THEN(                                                   //                                  ; Case 1 {
-            0x48, 0xBF, LONG_TO_BYTES(_rngSeedArray),           // mov rdi, _rngSeedArray           ;     Load in the table of RNG seeds
-            0x4A, 0x8B, 0x34, 0xC7,                             // mov rsi, qword ptr [rdi + r8*8]  ;     Look up the seed for this RNG category
-            0x48, 0x89, 0xF0                                    // mov rax, rsi                     ;     Save the seed as the return value (rax)
-        ),                                                      //                                  ; }
-        0x48, 0xBE, LONG_TO_BYTES(_rngBehaviors),               // mov rsi, _rngBehaviors           ; Load in the lookup table
-        IF_EQ(0x42, 0x80, 0x3C, 0x06, RngBehavior::Increment),  // cmp byte ptr [rsi + r8], 2       ; If this RNG category is using type 2 (steadily increasing value)
-        THEN(                                                   //                                  ; Case 2 {
-            0x48, 0xBF, LONG_TO_BYTES(_rngSeedArray),           // mov rdi, _rngSeedArray           ;     Load in the table of RNG seeds
-            0x4A, 0x8B, 0x34, 0xC7,                             // mov rsi, qword ptr [rdi + r8*8]  ;     Look up the seed for this RNG category
-            0x48, 0x89, 0xF0,                                   // mov rax, rsi                     ;     Save the seed as the return value (rax)
-            0x48, 0xFF, 0xC6,                                   // inc rsi                          ;     Increment the seed
-            0x4A, 0x89, 0x34, 0xC7                              // mov qword ptr [rdi + r8*8], rsi  ;     Save back the incremented seed value
-        ),                                                      //                                  ; }
-        0x48, 0xBE, LONG_TO_BYTES(_rngBehaviors),               // mov rsi, _rngBehaviors           ; Load in the lookup table
-        IF_EQ(0x42, 0x80, 0x3C, 0x06, RngBehavior::Randomize),  // cmp byte ptr [rsi + r8], 3       ; If this RNG category is using type 3 (pseudorandom value)
-        THEN(                                                   //                                  ; Case 3 {
-            0x48, 0xBF, LONG_TO_BYTES(_rngSeedArray),           // mov rdi, _rngSeedArray           ;     Load in the table of RNG seeds
-            0x4A, 0x8B, 0x34, 0xC7,                             // mov rsi, qword ptr [rdi + r8*8]  ;     Look up the seed for this RNG category
-            0x56,                                               // push rsi                         ;     Add our RNG seed data to the hash buffer
-            0x48, 0xBE, LONG_TO_BYTES(14695981039346656037),    // mov rsi, 14695981039346656037    ;     rsi = _FNV_offset_basis
-            0x48, 0xBF, LONG_TO_BYTES(1099511628211),           // mov rdi, 1099511628211           ;     rdi = _FNV_prime
-            0x48, 0xC7, 0xC0, INT_TO_BYTES(8),                  // mov rax, 8                       ;     rax = 8                   // We pushed an 8-byte register onto the stack, so the hash buffer size is 8.
-            DO_WHILE_NONZERO(                                   //                                  ;     do {
-                0x40, 0x32, 0x74, 0x04, 0xF8,                   // xor sil, byte ptr [rsp+rax-8]    ;         rdi = [rsp + rax - 8] // XOR in a byte from the buffer
-                0x48, 0x0F, 0xAF, 0xF7,                         // imul rsi, rdi                    ;         rsi *= rdi            // Multiply in a large prime
-                0x48, 0xFF, 0xC8                                // dec rax                          ;         rax--                 // Decrement loop variable (buffer size)
-            ),                                                  //                                  ;     } while (rax > 0)
-            0x48, 0x83, 0xC4, 0x8,                              // add rsp, 8                       ;     Restore the stack pointer (freeing our hash buffer)
-            0x48, 0xBF, LONG_TO_BYTES(_rngSeedArray),           // mov rdi, _rngSeedArray           ;     Load in the table of RNG seeds
-            0x4A, 0x8B, 0x04, 0xC7,                             // mov rax, qword ptr [rdi + r8*8]  ;     Save the *previous* seed value as the return value (rax)
-            0x4A, 0x89, 0x34, 0xC7                              // mov qword ptr [rdi + r8*8], rsi  ;     Save back the *new* seed value
-        ),                                                      //                                  ; }
-        0x89, 0xD6,                                             // mov esi, edx                     ; Copy out the upper limit into esi
-        0x29, 0xCE,                                             // sub esi, ecx                     ; Subtract the lower limit to compute the range
-        0x31, 0xD2,                                             // xor edx, edx                     ; Zero out edx (required for division, or in case esi is 0)
-        IF_NZ(0x85, 0xF6),                                      // test esi, esi                    ; Compare esi to itself
-        THEN(                                                   //                                  ; if (esi != 0) {
-            0xF7, 0xF6                                          // div esi                          ;   Compute edx = (edx:eax) % esi
+    // - Case 3: Advance the seed value, and return a pseudorandom value derived from it
+    // The behavior is dispatched through a small jump table, and the kernels only use volatile registers (no stack traffic).
+    // Cases 1 and 2 treat the seed as a literal value, which each kernel converts into its range (the "literal tail").
+    // Case 3 uses splitmix64, whose (uniform) output is converted into the range by the "random tail". See:
+    // https://prng.di.unimi.it/splitmix64.c
+    // Any change to the output of these kernels (for a given seed) must bump s_rngAlgorithm.
+    std::vector<byte> incrementCase = {
+        0x4C, 0x89, 0xC8,                                       // mov rax, r9                      ; Return the seed
+        0x49, 0xFF, 0xC1,                                       // inc r9                           ; Increment the seed
+        0x4F, 0x89, 0x0C, 0xC2,                                 // mov qword ptr [r10 + r8*8], r9   ; Save back the incremented seed value
+    };                                                          //                                  ; (falls through into the literal tail)
+    std::vector<byte> constantCase = {
+        0x4C, 0x89, 0xC8,                                       // mov rax, r9                      ; Return the seed
+        0xEB, static_cast<byte>(incrementCase.size()),          // jmp literalTail                  ;
+    };
+    std::vector<byte> notSetCase = {
+        0x31, 0xC0,                                             // xor eax, eax                     ; Return 0 (i.e. the lower limit)
+        0xEB, static_cast<byte>(constantCase.size() + incrementCase.size()), // jmp literalTail;
+    };
+    std::vector<byte> randomizeCase = {
+        0x48, 0xB8, LONG_TO_BYTES(0x9E3779B97F4A7C15),          // mov rax, 0x9E3779B97F4A7C15      ; splitmix64: Advance the seed by the golden gamma
+        0x49, 0x01, 0xC1,                                       // add r9, rax                      ;
+        0x4F, 0x89, 0x0C, 0xC2,                                 // mov qword ptr [r10 + r8*8], r9   ; Save back the new seed value
+        0x4C, 0x89, 0xC8,                                       // mov rax, r9                      ; Then mix the new seed into our result:
+        0x49, 0x89, 0xC3,                                       // mov r11, rax                     ;
+        0x49, 0xC1, 0xEB, 0x1E,                                 // shr r11, 30                      ;
+        0x4C, 0x31, 0xD8,                                       // xor rax, r11                     ;   rax ^= rax >> 30
+        0x49, 0xBB, LONG_TO_BYTES(0xBF58476D1CE4E5B9),          // mov r11, 0xBF58476D1CE4E5B9      ;
+        0x49, 0x0F, 0xAF, 0xC3,                                 // imul rax, r11                    ;   rax *= 0xBF58476D1CE4E5B9
+        0x49, 0x89, 0xC3,                                       // mov r11, rax                     ;
+        0x49, 0xC1, 0xEB, 0x1B,                                 // shr r11, 27                      ;
+        0x4C, 0x31, 0xD8,                                       // xor rax, r11                     ;   rax ^= rax >> 27
+        0x49, 0xBB, LONG_TO_BYTES(0x94D049BB133111EB),          // mov r11, 0x94D049BB133111EB      ;
+        0x49, 0x0F, 0xAF, 0xC3,                                 // imul rax, r11                    ;   rax *= 0x94D049BB133111EB
+        0x49, 0x89, 0xC3,                                       // mov r11, rax                     ;
+        0x49, 0xC1, 0xEB, 0x1F,                                 // shr r11, 31                      ;
+        0x4C, 0x31, 0xD8,                                       // xor rax, r11                     ;   rax ^= rax >> 31
+    };                                                          //                                  ; (falls through into the random tail)
+
+    // In record mode, each draw is appended to a ring in the game, which is drained by the heartbeat (see DrainRngRecording).
+    // Entries are claimed with a 'lock xadd' on the write count, and are complete once their sequence number (index + 1) is written.
+    // The kernels' epilogues only check the record flag unless recording is on. storeArgs writes the range and value into the entry at r10.
+    __int64 recordFlagOffset = GetRngRecordFlag() - _rngSeedArray;
+    auto assembleEpilogue = [&](const std::vector<byte>& storeArgs, const std::vector<byte>& finish) {
+        std::vector<byte> record = {
+            0x49, 0xBB, LONG_TO_BYTES(_rngRecordRing),          // mov r11, _rngRecordRing          ; Load the ring
+            0x41, 0xB9, INT_TO_BYTES(1),                        // mov r9d, 1                       ;
+            0xF0, 0x4D, 0x0F, 0xC1, 0x0B,                       // lock xadd qword ptr [r11], r9    ; Claim the next entry (r9 = its index)
+            0x4D, 0x89, 0xCA,                                   // mov r10, r9                      ;
+            0x41, 0x81, 0xE2, INT_TO_BYTES(s_rngRecordCapacity - 1), // and r10d, capacity - 1      ; Wrap the index around the ring
+            0x49, 0xC1, 0xE2, 0x05,                             // shl r10, 5                       ; r10 *= sizeof(RngRecordEntry)
+            0x4F, 0x8D, 0x54, 0x13, s_rngRecordHeaderSize,      // lea r10, [r11 + r10 + 40]        ; r10 = &entry
+            0x4C, 0x8B, 0x1C, 0x24,                             // mov r11, qword ptr [rsp]         ; Load our return address (which identifies the call site)
+            0x4D, 0x89, 0x1A,                                   // mov qword ptr [r10], r11         ; entry.returnAddress = r11
+        };
+        record.insert(record.end(), storeArgs.begin(), storeArgs.end());
+        record.insert(record.end(), {
+            0x45, 0x88, 0x42, 0x14,                             // mov byte ptr [r10 + 14], r8b     ; entry.rngClass = r8b
+            0x49, 0xFF, 0xC1,                                   // inc r9                           ;
+            0x4D, 0x89, 0x4A, 0x18,                             // mov qword ptr [r10 + 18], r9     ; entry.sequence = index + 1 (written last, to mark the entry as complete)
+        });
+        static_assert(sizeof(RngRecordEntry) == 0x20 && offsetof(RngRecordEntry, rngClass) == 0x14 && offsetof(RngRecordEntry, sequence) == 0x18);
+
+        std::vector<byte> epilogue = {
+            0x41, 0x80, 0xBA, INT_TO_BYTES(recordFlagOffset), 0x00, // cmp byte ptr [r10 + recordFlag], 0 ; If we are recording draws
+            0x74, static_cast<byte>(record.size()),             // je finish                        ;
+        };
+        epilogue.insert(epilogue.end(), record.begin(), record.end());
+        epilogue.insert(epilogue.end(), finish.begin(), finish.end());
+        return epilogue;
+    };
+
+    // Builds a kernel which computes rax for this RNG category, then runs the matching tail, then the epilogue.
+    // The literal tail must jump past the randomize case and the random tail; the random tail falls through into the epilogue.
+    auto assembleKernel = [&](const std::vector<byte>& literalTail, const std::vector<byte>& randomTail, const std::vector<byte>& epilogue) {
+        // Each jump table entry is the offset of its case from the start of the table.
+        byte jumpTableSize = RngBehavior::Randomize + 1;
+        std::vector<byte> kernel = {
+            0x45, 0x0F, 0xB6, 0xC0,                             // movzx r8d, r8b                   ; Clear any high bits on r8 (we used r8b to save our "category")
+            0x49, 0xBA, LONG_TO_BYTES(_rngSeedArray),           // mov r10, _rngSeedArray           ; Load in the table of RNG seeds
+            0x4F, 0x8B, 0x0C, 0xC2,                             // mov r9, qword ptr [r10 + r8*8]   ; Look up the seed for this RNG category
+            0x4B, 0xFF, 0x44, 0xC2, s_classCountersOffset,      // inc qword ptr [r10 + r8*8 + 50]  ; Count this draw (the class counters follow the seeds)
+            0x48, 0xB8, LONG_TO_BYTES(_rngBehaviors),           // mov rax, _rngBehaviors           ; Load in the lookup table
+            0x42, 0x0F, 0xB6, 0x04, 0x00,                       // movzx eax, byte ptr [rax + r8]   ; Look up the behavior for this RNG category
+            0x83, 0xE0, 0x03,                                   // and eax, 3                       ; Clamp it to the size of the jump table
+            0x4C, 0x8D, 0x1D, INT_TO_BYTES(10),                 // lea r11, [rip + 10]              ; Load the address of the jump table (just past the 'jmp rax')
+            0x41, 0x0F, 0xB6, 0x04, 0x03,                       // movzx eax, byte ptr [r11 + rax]  ; Look up the offset of this behavior's case
+            0x4C, 0x01, 0xD8,                                   // add rax, r11                     ;
+            0xFF, 0xE0,                                         // jmp rax                          ; Jump to it
+            jumpTableSize,                                      // RngBehavior::NotSet              ; The jump table
+            static_cast<byte>(jumpTableSize + notSetCase.size()), // RngBehavior::Constant          ;
+            static_cast<byte>(jumpTableSize + notSetCase.size() + constantCase.size()), // RngBehavior::Increment
+            static_cast<byte>(jumpTableSize + notSetCase.size() + constantCase.size() + incrementCase.size() + literalTail.size()), // RngBehavior::Randomize
+        };
+        for (const auto& piece : {notSetCase, constantCase, incrementCase, literalTail, randomizeCase, randomTail, epilogue}) {
+            kernel.insert(kernel.end(), piece.begin(), piece.end());
+        }
+        return kernel;
+    };
+
+    // Integer kernel: Random.Range(int minInclusive, int maxExclusive) => [min, max)
+    // Literal seeds are reduced into the range with a modulo. Random values use Lemire's multiply-shift instead, see:
+    // https://lemire.me/blog/2016/06/27/a-fast-alternative-to-the-modulo-reduction/
+    // Both tails finish with eax = result, ecx = lower limit, edx = upper limit.
+    std::vector<byte> lemireTail = {
+        0x41, 0x89, 0xD1,                                       // mov r9d, edx                     ; Copy out the upper limit into r9d
+        0x41, 0x29, 0xC9,                                       // sub r9d, ecx                     ; Subtract the lower limit to compute the range (this also clears the upper half of r9)
+        0x48, 0xC1, 0xE8, 0x20,                                 // shr rax, 32                      ; Keep the top 32 bits of our random value
+        0x49, 0x0F, 0xAF, 0xC1,                                 // imul rax, r9                     ; Scale it by the range
+        0x48, 0xC1, 0xE8, 0x20,                                 // shr rax, 32                      ; and keep the top 32 bits, which are in [0, range)
+        0x01, 0xC8,                                             // add eax, ecx                     ; Add the lower limit into eax (our return value)
+    };
+    std::vector<byte> moduloTail = {
+        0x41, 0x89, 0xD1,                                       // mov r9d, edx                     ; Copy out the upper limit into r9d
+        0x41, 0x29, 0xC9,                                       // sub r9d, ecx                     ; Subtract the lower limit to compute the range
+        0x41, 0x89, 0xD3,                                       // mov r11d, edx                    ; Save the upper limit (the division overwrites edx)
+        0x31, 0xD2,                                             // xor edx, edx                     ; Zero out edx (required for division, or in case r9d is 0)
+        IF_NZ(0x45, 0x85, 0xC9),                                // test r9d, r9d                    ; Compare r9d to itself
+        THEN(                                                   //                                  ; if (r9d != 0) {
+            0x41, 0xF7, 0xF1                                    // div r9d                          ;   Compute edx = (edx:eax) % r9d
         ),                                                      //                                  ; }
         0x89, 0xC8,                                             // mov eax, ecx                     ; Copy the lower limit into eax
         0x01, 0xD0,                                             // add eax, edx                     ; Add the remainder into eax (our return value)
-        0x5F,                                                   // pop rdi                          ; Restore our scratch registers
-        0x5E,                                                   // pop rsi                          ;
-        0xC3,                                                   // ret                              ;
+        0x44, 0x89, 0xDA,                                       // mov edx, r11d                    ; Restore the upper limit
+        0xEB, static_cast<byte>(randomizeCase.size() + lemireTail.size()), // jmp epilogue          ;
     };
+    std::vector<byte> intRngInstructions = assembleKernel(moduloTail, lemireTail, assembleEpilogue({
+        0x41, 0x89, 0x4A, 0x08,                                 // mov dword ptr [r10 + 8], ecx     ; entry.min = ecx
+        0x41, 0x89, 0x52, 0x0C,                                 // mov dword ptr [r10 + C], edx     ; entry.max = edx
+        0x41, 0x89, 0x42, 0x10,                                 // mov dword ptr [r10 + 10], eax    ; entry.value = eax
+    }, {
+        0xC3,                                                   // ret                              ;
+    }));
 
     _intRngFunction = _memory->AllocateArray(intRngInstructions.size());
-    _memory->WriteData<byte>({_intRngFunction}, intRngInstructions); // TODO: This should be _memory->Intercept, so that we can undo it :(
+    _memory->AddFeatureAllocation("Derandomize", _intRngFunction);
+    _memory->WriteData<byte>({_intRngFunction}, intRngInstructions);
+    _memory->SetJournalValue("Derandomize", "IntRngFunction", _intRngFunction);
+    _memory->SetJournalValue("Derandomize", "RngAlgorithm", s_rngAlgorithm);
+    static_assert(RngEmulator::s_rngAlgorithm == s_rngAlgorithm, "The seed search must emulate the kernels exactly");
 
-    std::vector<byte> floatRngInstructions = {
-        0x51,                                                   // push rcx                         ; Preserve rcx and rdx
-        0x52,                                                   // push rdx                         ;
-        0x48, 0x83, 0xEC, 0x10,                                 // sub rsp, 10                      ; Allocate space for our local variables, while staying fpu aligned
-        0xF3, 0x0F, 0x11, 0x14, 0x24,                           // movss [rsp], xmm2                ; Save xmm2 (we need this for scratch space)
-        0xB9, INT_TO_BYTES(0x0000),                             // mov ecx, 0                       ; Set the arguments for the integer RNG function
-        0xBA, INT_TO_BYTES(0xFFFF),                             // mov edx, 65536                   ;
-        0x48, 0xB8, LONG_TO_BYTES(_intRngFunction),             // mov rax, _intRngFunction         ; Load the address of our integer RNG function
-        0xFF, 0xD0,                                             // call rax                         ; rax = Call it with range [0, 65536)
-        0x89, 0x44, 0x24, 0x08,                                 // mov [rsp+8], eax                 ; Move the return value onto the stack
-        0xF3, 0x0F, 0x10, 0x54, 0x24, 0x08,                     // movss xmm2, [rsp+8]              ; so we can move it into a float
-        0x0F, 0x5B, 0xD2,                                       // cvtdq2ps xmm2, xmm2              ; and convert it from an integer to a float
-        0xC7, 0x44, 0x24, 0x0C, INT_TO_BYTES(0x47800000),       // mov [rsp+C], 65536.0f            ; Move the max range into our stack (as a float)
-        0xF3, 0x0F, 0x5E, 0x54, 0x24, 0x0C,                     // divss xmm2, [rsp+C]              ; Divide the random value to get a value in [0.0f, 1.0f)
-        0xF3, 0x0F, 0x5C, 0xC8,                                 // subss xmm1, xmm0                 ; Determine the requested float range
-        0xF3, 0x0F, 0x59, 0xD1,                                 // mulss xmm2, xmm1                 ; Scale up our random value to the size of the float range
-        0xF3, 0x0F, 0x58, 0xC2,                                 // addss xmm0, xmm2                 ; Add the random value to the minimum to get our final result in xmm0
-        0xF3, 0x0F, 0x10, 0x14, 0x24,                           // movss xmm2, [rsp]                ; Restore xmm2 from our saved location
-        0x48, 0x83, 0xC4, 0x10,                                 // add rsp, 10                      ; Restore the stack pointer (freeing our local variables)
-        0x5A,                                                   // pop rdx                          ; Restore rcx and rdx
-        0x59,                                                   // pop rcx                          ;
-        0xC3,                                                   // ret                              ;
+    // Float kernel: Random.Range(float minInclusive, float maxInclusive) => [min, max], and Random.value => [0.0, 1.0]
+    // The top 23 bits of rax become the mantissa of a float in [1.0, 2.0), which we then shift down to [0.0, 1.0).
+    // Literal seeds use their low 16 bits as a fraction of 65536, so that they keep a predictable meaning.
+    // The tail finishes with xmm2 = result, xmm0 = lower limit, xmm1 = upper limit.
+    std::vector<byte> toFloat = {
+        0x48, 0xC1, 0xE8, 0x29,                                 // shr rax, 41                      ; Keep the top 23 bits of our random value
+        0x0D, INT_TO_BYTES(0x3F800000),                         // or eax, 1.0f                     ; Use them as the mantissa of a float in [1.0f, 2.0f)
+        0x66, 0x0F, 0x6E, 0xD0,                                 // movd xmm2, eax                   ;
+        0x41, 0xBB, INT_TO_BYTES(0x3F800000),                   // mov r11d, 1.0f                   ;
+        0x66, 0x41, 0x0F, 0x6E, 0xDB,                           // movd xmm3, r11d                  ;
+        0xF3, 0x0F, 0x5C, 0xD3,                                 // subss xmm2, xmm3                 ; Subtract 1.0f to get a value in [0.0f, 1.0f)
+        0x0F, 0x28, 0xD9,                                       // movaps xmm3, xmm1                ;
+        0xF3, 0x0F, 0x5C, 0xD8,                                 // subss xmm3, xmm0                 ; Determine the requested float range
+        0xF3, 0x0F, 0x59, 0xD3,                                 // mulss xmm2, xmm3                 ; Scale up our random value to the size of the float range
+        0xF3, 0x0F, 0x58, 0xD0,                                 // addss xmm2, xmm0                 ; Add the minimum to get our final result in xmm2
     };
+    std::vector<byte> floatRngKernel = assembleKernel({
+        0x48, 0xC1, 0xE0, 0x30,                                 // shl rax, 48                      ; Move the low 16 bits of the seed to the top of rax
+        0xEB, static_cast<byte>(randomizeCase.size()),          // jmp toFloat                      ;
+    }, toFloat, assembleEpilogue({
+        0xF3, 0x41, 0x0F, 0x11, 0x42, 0x08,                     // movss dword ptr [r10 + 8], xmm0  ; entry.min = xmm0
+        0xF3, 0x41, 0x0F, 0x11, 0x4A, 0x0C,                     // movss dword ptr [r10 + C], xmm1  ; entry.max = xmm1
+        0xF3, 0x41, 0x0F, 0x11, 0x52, 0x10,                     // movss dword ptr [r10 + 10], xmm2 ; entry.value = xmm2
+    }, {
+        0x0F, 0x28, 0xC2,                                       // movaps xmm0, xmm2                ; Return the result in xmm0
+        0xC3,                                                   // ret                              ;
+    }));
 
-    _floatRngFunction = _memory->AllocateArray(sizeof(floatRngInstructions));
+    std::vector<byte> floatRngInstructions = {
+        0x0F, 0x57, 0xC0,                                       // xorps xmm0, xmm0                 ; Value entry point: The minimum is 0.0f
+        0x41, 0xBB, INT_TO_BYTES(0x3F800000),                   // mov r11d, 1.0f                   ;
+        0x66, 0x41, 0x0F, 0x6E, 0xCB,                           // movd xmm1, r11d                  ; and the maximum is 1.0f
+    };                                                          //                                  ; (falls through into the range entry point)
+    assert(floatRngInstructions.size() == s_floatRangeEntry, "[INTERNAL ERROR] The value entry point was resized without updating s_floatRangeEntry");
+    floatRngInstructions.insert(floatRngInstructions.end(), floatRngKernel.begin(), floatRngKernel.end());
+
+    _floatRngFunction = _memory->AllocateArray(floatRngInstructions.size());
+    _memory->AddFeatureAllocation("Derandomize", _floatRngFunction);
     _memory->WriteData<byte>({_floatRngFunction}, floatRngInstructions);
+    _memory->SetJournalValue("Derandomize", "FloatRngFunction", _floatRngFunction);
+}
+
+bool Trainer::RestoreCustomRng() {
+    // The restored allocations are laid out for the tables (and kernels) of the trainer which made them, so they only fit the same version.
+    _numRngCallSites = _sigScans1.size() + _sigScans2.size() + _sigScans3.size();
+    if (_memory->GetJournalValue("Derandomize", "RngCallSites") != static_cast<uint64_t>(_numRngCallSites) || GetRngAlgorithm() != s_rngAlgorithm) {
+        DebugPrint("The journaled RNG kernels were made by a different version of the trainer");
+        return false;
+    }
+    _rngSeedArray = _memory->GetJournalValue("Derandomize", "RngSeedArray");
+    _rngBehaviors = _memory->GetJournalValue("Derandomize", "RngBehaviors");
+    _rngRecordRing = _memory->GetJournalValue("Derandomize", "RngRecordRing");
+    _intRngFunction = _memory->GetJournalValue("Derandomize", "IntRngFunction");
+    _floatRngFunction = _memory->GetJournalValue("Derandomize", "FloatRngFunction");
+    MapRngCallSites();
+    return _rngSeedArray != 0 && _rngBehaviors != 0 && _rngRecordRing != 0 && _intRngFunction != 0 && _floatRngFunction != 0;
+}
+
+void Trainer::MapRngCallSites() {
+    // Recorded draws only know their return address, which is just past the (rewritten) call instruction.
+    std::lock_guard<std::mutex> l(_rngRecordMutex);
+    _rngCallSiteByReturnAddress.clear();
+    uint16_t siteIndex = 0;
+    for (auto* sigScans : {&_sigScans1, &_sigScans2, &_sigScans3}) {
+        for (const auto& sigScan : *sigScans) _rngCallSiteByReturnAddress[sigScan.foundAddress + 4] = siteIndex++;
+    }
+}
+
+bool Trainer::StartRngRecording(const std::wstring& name) {
+    std::lock_guard<std::mutex> l(_rngRecordMutex);
+    if (_rngLog.IsOpen()) return true;
+    if (_rngRecordRing == 0 || !_rngLog.Open(GetDataPath(name.c_str()).wstring())) return false;
+    _rngRecordReadCount = _memory->ReadData<uint64_t>({_rngRecordRing}, 1)[0]; // Skip anything from a previous recording
+    _memory->WriteData<byte>({GetRngRecordFlag()}, {1});
+    return true;
 }
 
-bool Trainer::FindAllRngFunctions() {
+void Trainer::StopRngRecording() {
+    std::lock_guard<std::mutex> l(_rngRecordMutex);
+    if (!_rngLog.IsOpen()) return;
+    _memory->WriteData<byte>({GetRngRecordFlag()}, {0});
+    DrainRngRecording();
+    _rngLog.Close();
+}
+
+void Trainer::DrainRngRecording() {
+    if (!_rngLog.IsOpen()) return;
+    uint64_t writeCount = _memory->ReadData<uint64_t>({_rngRecordRing}, 1)[0];
+    if (writeCount - _rngRecordReadCount > s_rngRecordCapacity) {
+        // We fell behind, and the game has already overwritten some entries.
+        DebugPrint("Dropped " + std::to_string(writeCount - _rngRecordReadCount - s_rngRecordCapacity) + " recorded RNG draws");
+        _rngRecordReadCount = writeCount - s_rngRecordCapacity;
+    }
+
+    // Read the pending entries in (at most) two batches, since they may wrap around the end of the ring.
+    std::vector<RngRecordEntry> entries;
+    while (_rngRecordReadCount + entries.size() < writeCount) {
+        uint64_t first = (_rngRecordReadCount + entries.size()) % s_rngRecordCapacity;
+        uint64_t count = std::min(writeCount - _rngRecordReadCount - entries.size(), s_rngRecordCapacity - first);
+        std::vector<RngRecordEntry> batch;
+        size_t numRead = _memory->ReadDataAcrossPages<RngRecordEntry>({_rngRecordRing + s_rngRecordHeaderSize + (__int64)(first * sizeof(RngRecordEntry))}, count, batch);
+        entries.insert(entries.end(), batch.begin(), batch.begin() + numRead);
+        if (numRead != count) break; // The read failed partway. We'll pick up the rest next time.
+    }
+
+    for (const auto& entry : entries) {
+        if (entry.sequence != _rngRecordReadCount + 1) break; // Claimed, but not written yet. We'll pick it up next time.
+        _rngRecordReadCount++;
+
+        RngDraw draw;
+        draw.rngClass = entry.rngClass;
+        auto search = _rngCallSiteByReturnAddress.find(entry.returnAddress);
+        draw.callSite = (search == _rngCallSiteByReturnAddress.end() ? RngDraw::s_unknownCallSite : search->second);
+        draw.min = entry.min;
+        draw.max = entry.max;
+        draw.value = entry.value;
+        _rngLog.Append(draw);
+    }
+    _rngLog.Flush();
+}
+
+void Trainer::DeclareRngScans() {
     // I have (painstakingly) generated a bunch of sigscans for all the BluePrince code locations which are calling into the RNG.
     // They are categorized on two dimensions:
     // - First, by the function they're using. This is important for our injection; each function class has a particular expected return type that we must match.
     // - Second, by the usage. This is important for modding, since we care about some of these random values more so than others.
     // I have also annotated the sigscan by the name of the calling function, to help justify the categorization.
 
-    /* TODO: Some call sites use this horrific IL2CPP behavior. I need to rescan for these and... write more injection. Eventually.
-      v95 = qword_18318CDC8;
-      if (!qword_18318CDC8) {
-        v95 = il2cpp_resolve_icall_0("UnityEngine.Random::RandomRangeInt(System.Int32,System.Int32)");
-        if (!v95) {
-          v102 = sub_1802C0F70("UnityEngine.Random::RandomRangeInt(System.Int32,System.Int32)");
-          sub_1802BF150(v102); // some assert
-        }
-        qword_18318CDC8 = v95;
-      }
-      v96 = v95(0, v94); // <-- actual function call here
-    */
+    // Some other call sites reach the RNG through an IL2CPP internal call instead; those are covered by RedirectIcallRngSlots.
 
     // UnityEngine::Random::Random.value => [0.0, 1.0]
-    _sigScans1 = {
-        { RngClass::DoNotTamper, "41 80 7E 29 00 48 8B D8", 17 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
-        { RngClass::DoNotTamper, "41 80 7E 29 00 48 8B D8", 30 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
-        { RngClass::DoNotTamper, "41 80 7E 29 00 48 8B D8", 43 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
-        { RngClass::DoNotTamper, "0F 84 6E 02 00 00 45 33 C0 33 D2", 22 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
-        { RngClass::DoNotTamper, "0F 84 6E 02 00 00 45 33 C0 33 D2", 32 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
-        { RngClass::DoNotTamper, "0F 84 6E 02 00 00 45 33 C0 33 D2", 42 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
-        { RngClass::BirdPathing, "F3 0F 11 43 64 0F 86 19 01 00 00", 23 }, // void BirdPather::BirdPather.Update()
-        { RngClass::BirdPathing, "F3 0F 10 4B 4C 0F 2F C8 0F 86 01 01 00 00", -4 }, // void BirdPather::BirdPather.JumpForwardsTick()
-        { RngClass::Rarity,      "48 8B 7C E9 20 48 85 FF", 17 }, // void RoomDraftContext::RoomDraftContext.ResetPlans()
-        { RngClass::Drafting,    "48 8B 01 48 39 47 10 74 5C 33 C9", 12 }, // void RoomDraftHelper::RoomDraftHelper.StartDraft() -> Seems to be used for determining if the Bookshop can be spawned
-        { RngClass::Rarity,      "48 8B 7C F1 20 48 85 FF 74 78", 13 }, // void RoomDraftRound::RoomDraftRound.RunbackFilter(DraftRankRarity probs)
-        { RngClass::Rarity,      "F3 41 0F 10 76 2C EB 06", 17 }, // void OuterDraftManager::OuterDraftManager.FilterRarityOutput()
-        { RngClass::Trading,     "EB 5A 85 FF 78 2C", -4 }, // void TradeManager::TradeManager.SetTradeOffer(ItemData item)
-        { RngClass::Trading,     "48 85 F6 75 76 33 C9", 8 },  // void TradeManager::TradeManager.SetTradeOffer(ItemData item)
-        { RngClass::DoNotTamper, "0F 2F C6 76 27 33 C9", 8 }, // void BluePrince::TestActionPrompter::TestActionPrompter.Update()
+    static constexpr SigScanTemplate s_sigScans1[] = {
+        { RngClass::DoNotTamper, SIG("41 80 7E 29 00 48 8B D8"), 17 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
+        { RngClass::DoNotTamper, SIG("41 80 7E 29 00 48 8B D8"), 30 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
+        { RngClass::DoNotTamper, SIG("41 80 7E 29 00 48 8B D8"), 43 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
+        { RngClass::DoNotTamper, SIG("0F 84 6E 02 00 00 45 33 C0 33 D2"), 22 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
+        { RngClass::DoNotTamper, SIG("0F 84 6E 02 00 00 45 33 C0 33 D2"), 32 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
+        { RngClass::DoNotTamper, SIG("0F 84 6E 02 00 00 45 33 C0 33 D2"), 42 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
+        { RngClass::BirdPathing, SIG("F3 0F 11 43 64 0F 86 19 01 00 00"), 23 }, // void BirdPather::BirdPather.Update()
+        { RngClass::BirdPathing, SIG("F3 0F 10 4B 4C 0F 2F C8 0F 86 01 01 00 00"), -4 }, // void BirdPather::BirdPather.JumpForwardsTick()
+        { RngClass::Rarity,      SIG("48 8B 7C E9 20 48 85 FF"), 17 }, // void RoomDraftContext::RoomDraftContext.ResetPlans()
+        { RngClass::Drafting,    SIG("48 8B 01 48 39 47 10 74 5C 33 C9"), 12 }, // void RoomDraftHelper::RoomDraftHelper.StartDraft() -> Seems to be used for determining if the Bookshop can be spawned
+        { RngClass::Rarity,      SIG("48 8B 7C F1 20 48 85 FF 74 78"), 13 }, // void RoomDraftRound::RoomDraftRound.RunbackFilter(DraftRankRarity probs)
+        { RngClass::Rarity,      SIG("F3 41 0F 10 76 2C EB 06"), 17 }, // void OuterDraftManager::OuterDraftManager.FilterRarityOutput()
+        { RngClass::Trading,     SIG("EB 5A 85 FF 78 2C"), -4 }, // void TradeManager::TradeManager.SetTradeOffer(ItemData item)
+        { RngClass::Trading,     SIG("48 85 F6 75 76 33 C9"), 8 },  // void TradeManager::TradeManager.SetTradeOffer(ItemData item)
+        { RngClass::DoNotTamper, SIG("0F 2F C6 76 27 33 C9"), 8 }, // void BluePrince::TestActionPrompter::TestActionPrompter.Update()
     };
 
     // UnityEngine::Random::Random.Range(int minInclusive, int maxExclusive) => [min, max)
-    _sigScans2 = {
-        { RngClass::DoNotTamper, "8B 57 1C 45 33 C0 8B", 12 }, // void VLB::DynamicOcclusionAbstractBase::DynamicOcclusionAbstractBase.ProcessOcclusion(DynamicOcclusionAbstractBase.ProcessOcclusionSource source)
-        { RngClass::DoNotTamper, "45 33 C0 BA 68 01 00 00 33", -4 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
-        { RngClass::DoNotTamper, "45 33 C0 BA 68 01 00 00 33", 13 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
-        { RngClass::DoNotTamper, "F3 0F 11 43 5C 41", 13 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
-        { RngClass::DoNotTamper, "B9 0C FE FF FF", 9 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
-        { RngClass::DogSwapper,  "74 0E 45 33 C0 8B D6", 10 }, // void Kennel_DogSwapper::Kennel_DogSwapper.RegenerateCombinations() -> Seems to be used for knuth randomization of a list of some sort
-        { RngClass::Drafting,    "2B 4F 30 8B 50 18", 9 }, // RoomCard RoomDeck::RoomDeck.PickTop(bool reshuffle)
-        { RngClass::DoNotTamper, "0F 84 F9 00 00 00 8B 56", 15 }, // void HutongGames::PlayMaker::Actions::SetRandomMaterial::SetRandomMaterial.DoSetRandomMaterial()
-        { RngClass::DoNotTamper, "48 63 C8 3B 4B 18 73 50", -4 }, // void HutongGames::PlayMaker::Actions::SetRandomMaterial::SetRandomMaterial.DoSetRandomMaterial()
-        { RngClass::DoNotTamper, "66 0F 6E C3 0F 5B C0 66 0F 6E F8", -4 }, // void HutongGames::PlayMaker::Actions::Vector2RandomValue::Vector2RandomValue.DoRandomVector2() -> Unused
-        { RngClass::Trading,     "48 63 C8 3B 4B 18 73 31", -4 }, // ItemData TradeManager::TradeManager.PickFromTradingTier(int tier) -> Seems to be directly picking the random item to provide (from a given list)
-        { RngClass::Derigiblock, "74 48 45 33 C0 8B 53", 11 }, // Object Derigiblocks::DerigiblocksBlockDatabase::DerigiblocksBlockDatabase.GetBlock(DerigiblocksBlockType type)
-        { RngClass::DoNotTamper, "38 4B 1C 0F 95 C1", 10 }, // AudioClip SoundeR::AudioPicker::AudioPicker.GetAudioClip()
+    static constexpr SigScanTemplate s_sigScans2[] = {
+        { RngClass::DoNotTamper, SIG("8B 57 1C 45 33 C0 8B"), 12 }, // void VLB::DynamicOcclusionAbstractBase::DynamicOcclusionAbstractBase.ProcessOcclusion(DynamicOcclusionAbstractBase.ProcessOcclusionSource source)
+        { RngClass::DoNotTamper, SIG("45 33 C0 BA 68 01 00 00 33"), -4 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
+        { RngClass::DoNotTamper, SIG("45 33 C0 BA 68 01 00 00 33"), 13 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
+        { RngClass::DoNotTamper, SIG("F3 0F 11 43 5C 41"), 13 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
+        { RngClass::DoNotTamper, SIG("B9 0C FE FF FF"), 9 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
+        { RngClass::DogSwapper,  SIG("74 0E 45 33 C0 8B D6"), 10 }, // void Kennel_DogSwapper::Kennel_DogSwapper.RegenerateCombinations() -> Seems to be used for knuth randomization of a list of some sort
+        { RngClass::Drafting,    SIG("2B 4F 30 8B 50 18"), 9 }, // RoomCard RoomDeck::RoomDeck.PickTop(bool reshuffle)
+        { RngClass::DoNotTamper, SIG("0F 84 F9 00 00 00 8B 56"), 15 }, // void HutongGames::PlayMaker::Actions::SetRandomMaterial::SetRandomMaterial.DoSetRandomMaterial()
+        { RngClass::DoNotTamper, SIG("48 63 C8 3B 4B 18 73 50"), -4 }, // void HutongGames::PlayMaker::Actions::SetRandomMaterial::SetRandomMaterial.DoSetRandomMaterial()
+        { RngClass::DoNotTamper, SIG("66 0F 6E C3 0F 5B C0 66 0F 6E F8"), -4 }, // void HutongGames::PlayMaker::Actions::Vector2RandomValue::Vector2RandomValue.DoRandomVector2() -> Unused
+        { RngClass::Trading,     SIG("48 63 C8 3B 4B 18 73 31"), -4 }, // ItemData TradeManager::TradeManager.PickFromTradingTier(int tier) -> Seems to be directly picking the random item to provide (from a given list)
+        { RngClass::Derigiblock, SIG("74 48 45 33 C0 8B 53"), 11 }, // Object Derigiblocks::DerigiblocksBlockDatabase::DerigiblocksBlockDatabase.GetBlock(DerigiblocksBlockType type)
+        { RngClass::DoNotTamper, SIG("38 4B 1C 0F 95 C1"), 10 }, // AudioClip SoundeR::AudioPicker::AudioPicker.GetAudioClip()
     };
 
     // UnityEngine::Random::Random.Range(float minInclusive, float maxInclusive) => [min, max]
-    _sigScans3 = {
-        { RngClass::DoNotTamper, "83 7F 18 02 0F 86 1E 05 00 00", -4 }, // void iTween::iTween.ApplyShakePositionTargets()
-        { RngClass::DoNotTamper, "83 7F 18 02 0F 86 DA 04 00 00", -4 }, // void iTween::iTween.ApplyShakePositionTargets()
-        { RngClass::DoNotTamper, "83 7F 18 02 0F 86 96 04 00 00", -4 }, // void iTween::iTween.ApplyShakePositionTargets()
-        { RngClass::DoNotTamper, "83 7F 18 02 0F 86 EF 01 00 00", -4 }, // void iTween::iTween.ApplyShakeScaleTargets()
-        { RngClass::DoNotTamper, "83 7F 18 02 0F 86 A7 01 00 00", -4 }, // void iTween::iTween.ApplyShakeScaleTargets()
-        { RngClass::DoNotTamper, "83 7F 18 02 0F 86 5F 01 00 00", -4 }, // void iTween::iTween.ApplyShakeScaleTargets()
-        { RngClass::DoNotTamper, "83 7F 18 02 0F 86 E0 02 00 00", -4 }, // void iTween::iTween.ApplyShakeRotationTargets()
-        { RngClass::DoNotTamper, "83 7F 18 02 0F 86 9C 02 00 00", -4 }, // void iTween::iTween.ApplyShakeRotationTargets()
-        { RngClass::DoNotTamper, "83 7F 18 02 0F 86 58 02 00 00", -4 }, // void iTween::iTween.ApplyShakeRotationTargets()
-        { RngClass::DoNotTamper, "0F 29 70 E8 49 8B F8", 59 }, // Vector3 VLB::DynamicOcclusionRaycasting::DynamicOcclusionRaycasting.GetRandomVectorAround(Vector3 direction, float angleDiff)
-        { RngClass::DoNotTamper, "0F 29 70 E8 49 8B F8", 78 }, // Vector3 VLB::DynamicOcclusionRaycasting::DynamicOcclusionRaycasting.GetRandomVectorAround(Vector3 direction, float angleDiff)
-        { RngClass::DoNotTamper, "0F 29 70 E8 49 8B F8", 96 }, // Vector3 VLB::DynamicOcclusionRaycasting::DynamicOcclusionRaycasting.GetRandomVectorAround(Vector3 direction, float angleDiff)
-        { RngClass::DoNotTamper, "45 33 C0 F3 0F 10 47 58", 9 }, // bool VLB::EffectFlicker::_CoUpdate_d__9::EffectFlicker_CoUpdate_d_9_MoveNext(EffectFlicker_CoUpdate_d_9 *this,MethodInfo *method)
-        { RngClass::DoNotTamper, "45 33 C0 F3 0F 10 47 50", 9 }, // bool VLB::EffectFlicker::_CoFlicker_d__10::EffectFlicker_CoFlicker_d_10_MoveNext(EffectFlicker_CoFlicker_d_10 *this,MethodInfo *method)
-        { RngClass::DoNotTamper, "F3 0F 10 4F 64", 11 }, // bool VLB::EffectFlicker::_CoFlicker_d__10::EffectFlicker_CoFlicker_d_10_MoveNext(EffectFlicker_CoFlicker_d_10 *this,MethodInfo *method)
-        { RngClass::DoNotTamper, "CC F3 0F 10 49 04 45", 14 }, // float VLB::MinMaxRangeFloat::FloatRegion.Random -> Unused
-        { RngClass::DoNotTamper, "41 0F 28 CA 0F 11 43 20", 13 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
-        { RngClass::DoNotTamper, "41 0F 28 CA 0F 11 43 20", 37 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
-        { RngClass::DoNotTamper, "41 0F 28 CA 0F 11 43 20", 57 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
-        { RngClass::DoNotTamper, "45 33 C0 41 0F 28 CA 41", 12 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
-        { RngClass::DoNotTamper, "45 33 C0 41 0F 28 CA 41", 46 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
-        { RngClass::DoNotTamper, "45 33 C0 41 0F 28 CA 41", 76 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
-        { RngClass::DoNotTamper, "45 33 C0 41 0F 28 C8 0F 57", 11 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
-        { RngClass::DoNotTamper, "89 43 68 41 0F 28 CE", 12 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
-        { RngClass::DoNotTamper, "0F 28 CE 0F 57 C0 48", 10 }, // void Rewired::Demos::CustomControllerDemo_Player::CustomControllerDemo_Player.Update()
-        { RngClass::DoNotTamper, "0F 28 CE 0F 57 C0 48", 27 }, // void Rewired::Demos::CustomControllerDemo_Player::CustomControllerDemo_Player.Update()
-        { RngClass::DoNotTamper, "0F 28 CE 0F 57 C0 48", 45 }, // void Rewired::Demos::CustomControllerDemo_Player::CustomControllerDemo_Player.Update()
-        { RngClass::DoNotTamper, "F3 0F 10 4F 1C 45 33 C0 F3", 14 }, // void ElectricArcObject::ElectricArcObject.Start()
-        { RngClass::DoNotTamper, "20 F3 0F 10 49 1C 45", 18 }, // void ElectricArcObject::ElectricArcObject.ResetTimer()
-        { RngClass::DoNotTamper, "48 8B 4F 28 F3 0F 11 47 48", -4 }, // void ElectricArcObject::ElectricArcObject.Fire()
-        { RngClass::SlotMachine, "0F 28 F0 4C 8B 4F 30", -4 }, // void SlotMachineBrain::SlotMachineBrain.StartNewSpin() -> Used to determine the duration that a reel spins for
-        { RngClass::SlotMachine, "F3 0F 10 70 20 0F 28", 16 }, // void SlotMachineWheel::SlotMachineWheel.StartSpinning() -> Used to determine how fast the slots spin
-        { RngClass::SlotMachine, "0F 28 F0 4C 8B 4F 30", -4 }, // void SlotMachineWheel::SlotMachineWheel.StopSpinning() -> Used to determine what angle the slots stop at
-        { RngClass::DoNotTamper, "F3 0F 10 4B 20 45 33 C0 F3", 14 }, // void UnityStandardAssets::ImageEffects::NoiseAndScratches::NoiseAndScratches.OnRenderImage(RenderTexture *source, RenderTexture *destination)
-        { RngClass::DoNotTamper, "F3 0F 10 4B 20 45 33 C0 F3", 35 }, // void UnityStandardAssets::ImageEffects::NoiseAndScratches::NoiseAndScratches.OnRenderImage(RenderTexture *source, RenderTexture *destination)
-        { RngClass::DoNotTamper, "48 8B 73 78 0F 28 F0", -4 }, // void HutongGames::PlayMaker::Actions::Flicker::Flicker.OnUpdate()
-        { RngClass::DoNotTamper, "F3 0F 10 43 38 0F 28 C8 45", 15 }, // void HutongGames::PlayMaker::Actions::RandomFloat::RandomFloat.OnEnter()
-        { RngClass::DoNotTamper, "48 8B 4F 70 0F 28 F0", 33 }, // void HutongGames::PlayMaker::Actions::Vector2RandomValue::Vector2RandomValue.DoRandomVector2()
-        { RngClass::DoNotTamper, "0F 28 F0 48 85 C9 0F 84 68", 29 }, // void HutongGames::PlayMaker::Actions::Vector2RandomValue::Vector2RandomValue.DoRandomVector2()
-        { RngClass::DoNotTamper, "44 0F 28 C0 0F 28 C8 0F 28 C7", 14 }, // void HutongGames::PlayMaker::Actions::Vector2RandomValue::Vector2RandomValue.DoRandomVector2()
-        { RngClass::DoNotTamper, "F3 0F 11 87 88 00 00 00 45", 19 }, // void HutongGames::PlayMaker::Actions::Vector2RandomValue::Vector2RandomValue.DoRandomVector2()
-        { RngClass::DoNotTamper, "F3 0F 10 4C 24 64 F3 0F 59 D0", -10 }, // void HutongGames::PlayMaker::Actions::Vector2RandomValue::Vector2RandomValue.DoRandomVector2()
-        { RngClass::DoNotTamper, "0F 57 C9 F3 0F 11 43 74", -4 }, // void HutongGames::PlayMaker::Actions::RandomWait::RandomWait.OnEnter()
-        { RngClass::DoNotTamper, "F3 41 0F 10 49 2C", 16 }, // void ECprojectileActor::ECprojectileActor.Fire()
-        { RngClass::DoNotTamper, "45 33 C0 41 0F 28 CC 0F", 11 }, // void UnityStandardAssets::ImageEffects::NoiseAndGrain::NoiseAndGrain.DrawNoiseQuadGrid(RenderTexture source, RenderTexture dest, Material fxMaterial, Texture2D noise, int passNr)
-        { RngClass::DoNotTamper, "0F 57 C0 41 0F 28 CC", 13 }, // void UnityStandardAssets::ImageEffects::NoiseAndGrain::NoiseAndGrain.DrawNoiseQuadGrid(RenderTexture source, RenderTexture dest, Material fxMaterial, Texture2D noise, int passNr)
-        { RngClass::DoNotTamper, "F3 45 0F 5C D6 F3 41", -4 }, // DG::Tweening::DOTween::DOTween_Shake(...)
-        { RngClass::DoNotTamper, "0F 85 3C 01 00 00 41 0F 28", 22 }, // DG::Tweening::DOTween::DOTween_Shake(...)
-        { RngClass::DoNotTamper, "02 00 00 41 0F 28 C1 45 33 C0", 19 }, // DG::Tweening::DOTween::DOTween_Shake(...)
-        { RngClass::DoNotTamper, "80 79 08 00 F3 0F 10 01", 19 }, // float FluffyUnderware::DevTools::FloatRegion::FloatRegion.Next()
-        { RngClass::DoNotTamper, "84 05 00 00 80 78 1C 00 75 0A", 34 }, // AudioSource SoundeR::AudioEmitter::AudioEmitter.PlaySoundAtPosition(AudioCollectionAsset collection, Vector3 worldPosition, bool attachToParent)
-        { RngClass::DoNotTamper, "47 05 00 00 80 78 1C 00 75 0A", 34 }, // AudioSource SoundeR::AudioEmitter::AudioEmitter.PlaySoundAtPosition(AudioCollectionAsset collection, Vector3 worldPosition, bool attachToParent)
-        { RngClass::DoNotTamper, "73 05 00 00 80 78 1C 00 75 0A", 34 }, // AudioSource SoundeR::AudioEmitter::AudioEmitter.PlaySoundAtPosition(AudioCollectionAsset collection, Vector3 worldPosition, int index, bool attachToParent)
-        { RngClass::DoNotTamper, "36 05 00 00 80 78 1C 00 75 0A", 34 }, // AudioSource SoundeR::AudioEmitter::AudioEmitter.PlaySoundAtPosition(AudioCollectionAsset collection, Vector3 worldPosition, int index, bool attachToParent)
-        { RngClass::DoNotTamper, "EB 2B F3 44 0F 10 84 24 90 00 00 00", -4 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.Refresh()
-        { RngClass::DoNotTamper, "EB 2F F3 0F 10 BC 24 90 00 00 00", -4 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.Refresh()
-        { RngClass::DoNotTamper, "44 0F 28 D8 E9 80 00 00 00", -4 }, // bool FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.AddGroupItems()
-        { RngClass::DoNotTamper, "44 0F 28 D8 EB 3A", -4 }, // bool FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.AddGroupItems()
-        { RngClass::DoNotTamper, "44 0F 28 D0 E9 80 00 00 00", -4 }, // bool FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.AddGroupItems()
-        { RngClass::DoNotTamper, "44 0F 28 D0 EB 3A", -4 }, // bool FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.AddGroupItems()
-        { RngClass::DoNotTamper, "0F 28 F0 EB 69", -4 }, // BuildVolumeSpots FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetSpot()
-        { RngClass::DoNotTamper, "0F 28 F0 EB 38", -4 }, // BuildVolumeSpots FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetSpot()
-        { RngClass::DoNotTamper, "1E F3 0F 10 49 04", 14 }, // float FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetRegionNextValue()
-        { RngClass::DoNotTamper, "44 0F 28 C0 EB 3A", -4 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS()
-        { RngClass::DoNotTamper, "0F 28 F8 EB 39", -4 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS()
-        { RngClass::DoNotTamper, "0F 29 B4 24 C0 00 00 00 89", 48 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS()
-        { RngClass::DoNotTamper, "75 1D F3 0F 10 4B 60", 22 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS()
-        { RngClass::DoNotTamper, "75 1D F3 0F 10 4B 6C", 22 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS()
-        { RngClass::DoNotTamper, "75 1D F3 0F 10 4B 78", 22 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS()
-        { RngClass::DoNotTamper, "75 23 F3 0F 10 8B B0 00 00 00", 28 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS()
-        { RngClass::DoNotTamper, "75 23 F3 0F 10 8B BC 00 00 00", 28 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS()
-        { RngClass::DoNotTamper, "75 20 F3 0F 10 8B C8 00 00 00", 25 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS()
-        { RngClass::DoNotTamper, "75 0D F3 0F 10 4D 8B", 11 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS630()
-        { RngClass::DoNotTamper, "75 46 F3 0F 10 4D 9B", 11 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS630()
-        { RngClass::DoNotTamper, "F3 0F 11 46 08 66", -11 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS630()
-        { RngClass::DoNotTamper, "F3 0F 11 07 66 0F 7F 75 B7", -11 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS630()
-        { RngClass::DoNotTamper, "F3 0F 11 47 04 66", -11 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS630()
-        { RngClass::DoNotTamper, "F3 0F 11 47 08 66", -11 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS630()
+    static constexpr SigScanTemplate s_sigScans3[] = {
+        { RngClass::DoNotTamper, SIG("83 7F 18 02 0F 86 1E 05 00 00"), -4 }, // void iTween::iTween.ApplyShakePositionTargets()
+        { RngClass::DoNotTamper, SIG("83 7F 18 02 0F 86 DA 04 00 00"), -4 }, // void iTween::iTween.ApplyShakePositionTargets()
+        { RngClass::DoNotTamper, SIG("83 7F 18 02 0F 86 96 04 00 00"), -4 }, // void iTween::iTween.ApplyShakePositionTargets()
+        { RngClass::DoNotTamper, SIG("83 7F 18 02 0F 86 EF 01 00 00"), -4 }, // void iTween::iTween.ApplyShakeScaleTargets()
+        { RngClass::DoNotTamper, SIG("83 7F 18 02 0F 86 A7 01 00 00"), -4 }, // void iTween::iTween.ApplyShakeScaleTargets()
+        { RngClass::DoNotTamper, SIG("83 7F 18 02 0F 86 5F 01 00 00"), -4 }, // void iTween::iTween.ApplyShakeScaleTargets()
+        { RngClass::DoNotTamper, SIG("83 7F 18 02 0F 86 E0 02 00 00"), -4 }, // void iTween::iTween.ApplyShakeRotationTargets()
+        { RngClass::DoNotTamper, SIG("83 7F 18 02 0F 86 9C 02 00 00"), -4 }, // void iTween::iTween.ApplyShakeRotationTargets()
+        { RngClass::DoNotTamper, SIG("83 7F 18 02 0F 86 58 02 00 00"), -4 }, // void iTween::iTween.ApplyShakeRotationTargets()
+        { RngClass::DoNotTamper, SIG("0F 29 70 E8 49 8B F8"), 59 }, // Vector3 VLB::DynamicOcclusionRaycasting::DynamicOcclusionRaycasting.GetRandomVectorAround(Vector3 direction, float angleDiff)
+        { RngClass::DoNotTamper, SIG("0F 29 70 E8 49 8B F8"), 78 }, // Vector3 VLB::DynamicOcclusionRaycasting::DynamicOcclusionRaycasting.GetRandomVectorAround(Vector3 direction, float angleDiff)
+        { RngClass::DoNotTamper, SIG("0F 29 70 E8 49 8B F8"), 96 }, // Vector3 VLB::DynamicOcclusionRaycasting::DynamicOcclusionRaycasting.GetRandomVectorAround(Vector3 direction, float angleDiff)
+        { RngClass::DoNotTamper, SIG("45 33 C0 F3 0F 10 47 58"), 9 }, // bool VLB::EffectFlicker::_CoUpdate_d__9::EffectFlicker_CoUpdate_d_9_MoveNext(EffectFlicker_CoUpdate_d_9 *this,MethodInfo *method)
+        { RngClass::DoNotTamper, SIG("45 33 C0 F3 0F 10 47 50"), 9 }, // bool VLB::EffectFlicker::_CoFlicker_d__10::EffectFlicker_CoFlicker_d_10_MoveNext(EffectFlicker_CoFlicker_d_10 *this,MethodInfo *method)
+        { RngClass::DoNotTamper, SIG("F3 0F 10 4F 64"), 11 }, // bool VLB::EffectFlicker::_CoFlicker_d__10::EffectFlicker_CoFlicker_d_10_MoveNext(EffectFlicker_CoFlicker_d_10 *this,MethodInfo *method)
+        { RngClass::DoNotTamper, SIG("CC F3 0F 10 49 04 45"), 14 }, // float VLB::MinMaxRangeFloat::FloatRegion.Random -> Unused
+        { RngClass::DoNotTamper, SIG("41 0F 28 CA 0F 11 43 20"), 13 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
+        { RngClass::DoNotTamper, SIG("41 0F 28 CA 0F 11 43 20"), 37 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
+        { RngClass::DoNotTamper, SIG("41 0F 28 CA 0F 11 43 20"), 57 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
+        { RngClass::DoNotTamper, SIG("45 33 C0 41 0F 28 CA 41"), 12 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
+        { RngClass::DoNotTamper, SIG("45 33 C0 41 0F 28 CA 41"), 46 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
+        { RngClass::DoNotTamper, SIG("45 33 C0 41 0F 28 CA 41"), 76 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
+        { RngClass::DoNotTamper, SIG("45 33 C0 41 0F 28 C8 0F 57"), 11 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
+        { RngClass::DoNotTamper, SIG("89 43 68 41 0F 28 CE"), 12 }, // void VLB_Samples::LightGenerator::LightGenerator.Generate()
+        { RngClass::DoNotTamper, SIG("0F 28 CE 0F 57 C0 48"), 10 }, // void Rewired::Demos::CustomControllerDemo_Player::CustomControllerDemo_Player.Update()
+        { RngClass::DoNotTamper, SIG("0F 28 CE 0F 57 C0 48"), 27 }, // void Rewired::Demos::CustomControllerDemo_Player::CustomControllerDemo_Player.Update()
+        { RngClass::DoNotTamper, SIG("0F 28 CE 0F 57 C0 48"), 45 }, // void Rewired::Demos::CustomControllerDemo_Player::CustomControllerDemo_Player.Update()
+        { RngClass::DoNotTamper, SIG("F3 0F 10 4F 1C 45 33 C0 F3"), 14 }, // void ElectricArcObject::ElectricArcObject.Start()
+        { RngClass::DoNotTamper, SIG("20 F3 0F 10 49 1C 45"), 18 }, // void ElectricArcObject::ElectricArcObject.ResetTimer()
+        { RngClass::DoNotTamper, SIG("48 8B 4F 28 F3 0F 11 47 48"), -4 }, // void ElectricArcObject::ElectricArcObject.Fire()
+        { RngClass::SlotMachine, SIG("0F 28 F0 4C 8B 4F 30"), -4 }, // void SlotMachineBrain::SlotMachineBrain.StartNewSpin() -> Used to determine the duration that a reel spins for
+        { RngClass::SlotMachine, SIG("F3 0F 10 70 20 0F 28"), 16 }, // void SlotMachineWheel::SlotMachineWheel.StartSpinning() -> Used to determine how fast the slots spin
+        { RngClass::SlotMachine, SIG("0F 28 F0 4C 8B 4F 30"), -4 }, // void SlotMachineWheel::SlotMachineWheel.StopSpinning() -> Used to determine what angle the slots stop at
+        { RngClass::DoNotTamper, SIG("F3 0F 10 4B 20 45 33 C0 F3"), 14 }, // void UnityStandardAssets::ImageEffects::NoiseAndScratches::NoiseAndScratches.OnRenderImage(RenderTexture *source, RenderTexture *destination)
+        { RngClass::DoNotTamper, SIG("F3 0F 10 4B 20 45 33 C0 F3"), 35 }, // void UnityStandardAssets::ImageEffects::NoiseAndScratches::NoiseAndScratches.OnRenderImage(RenderTexture *source, RenderTexture *destination)
+        { RngClass::DoNotTamper, SIG("48 8B 73 78 0F 28 F0"), -4 }, // void HutongGames::PlayMaker::Actions::Flicker::Flicker.OnUpdate()
+        { RngClass::DoNotTamper, SIG("F3 0F 10 43 38 0F 28 C8 45"), 15 }, // void HutongGames::PlayMaker::Actions::RandomFloat::RandomFloat.OnEnter()
+        { RngClass::DoNotTamper, SIG("48 8B 4F 70 0F 28 F0"), 33 }, // void HutongGames::PlayMaker::Actions::Vector2RandomValue::Vector2RandomValue.DoRandomVector2()
+        { RngClass::DoNotTamper, SIG("0F 28 F0 48 85 C9 0F 84 68"), 29 }, // void HutongGames::PlayMaker::Actions::Vector2RandomValue::Vector2RandomValue.DoRandomVector2()
+        { RngClass::DoNotTamper, SIG("44 0F 28 C0 0F 28 C8 0F 28 C7"), 14 }, // void HutongGames::PlayMaker::Actions::Vector2RandomValue::Vector2RandomValue.DoRandomVector2()
+        { RngClass::DoNotTamper, SIG("F3 0F 11 87 88 00 00 00 45"), 19 }, // void HutongGames::PlayMaker::Actions::Vector2RandomValue::Vector2RandomValue.DoRandomVector2()
+        { RngClass::DoNotTamper, SIG("F3 0F 10 4C 24 64 F3 0F 59 D0"), -10 }, // void HutongGames::PlayMaker::Actions::Vector2RandomValue::Vector2RandomValue.DoRandomVector2()
+        { RngClass::DoNotTamper, SIG("0F 57 C9 F3 0F 11 43 74"), -4 }, // void HutongGames::PlayMaker::Actions::RandomWait::RandomWait.OnEnter()
+        { RngClass::DoNotTamper, SIG("F3 41 0F 10 49 2C"), 16 }, // void ECprojectileActor::ECprojectileActor.Fire()
+        { RngClass::DoNotTamper, SIG("45 33 C0 41 0F 28 CC 0F"), 11 }, // void UnityStandardAssets::ImageEffects::NoiseAndGrain::NoiseAndGrain.DrawNoiseQuadGrid(RenderTexture source, RenderTexture dest, Material fxMaterial, Texture2D noise, int passNr)
+        { RngClass::DoNotTamper, SIG("0F 57 C0 41 0F 28 CC"), 13 }, // void UnityStandardAssets::ImageEffects::NoiseAndGrain::NoiseAndGrain.DrawNoiseQuadGrid(RenderTexture source, RenderTexture dest, Material fxMaterial, Texture2D noise, int passNr)
+        { RngClass::DoNotTamper, SIG("F3 45 0F 5C D6 F3 41"), -4 }, // DG::Tweening::DOTween::DOTween_Shake(...)
+        { RngClass::DoNotTamper, SIG("0F 85 3C 01 00 00 41 0F 28"), 22 }, // DG::Tweening::DOTween::DOTween_Shake(...)
+        { RngClass::DoNotTamper, SIG("02 00 00 41 0F 28 C1 45 33 C0"), 19 }, // DG::Tweening::DOTween::DOTween_Shake(...)
+        { RngClass::DoNotTamper, SIG("80 79 08 00 F3 0F 10 01"), 19 }, // float FluffyUnderware::DevTools::FloatRegion::FloatRegion.Next()
+        { RngClass::DoNotTamper, SIG("84 05 00 00 80 78 1C 00 75 0A"), 34 }, // AudioSource SoundeR::AudioEmitter::AudioEmitter.PlaySoundAtPosition(AudioCollectionAsset collection, Vector3 worldPosition, bool attachToParent)
+        { RngClass::DoNotTamper, SIG("47 05 00 00 80 78 1C 00 75 0A"), 34 }, // AudioSource SoundeR::AudioEmitter::AudioEmitter.PlaySoundAtPosition(AudioCollectionAsset collection, Vector3 worldPosition, bool attachToParent)
+        { RngClass::DoNotTamper, SIG("73 05 00 00 80 78 1C 00 75 0A"), 34 }, // AudioSource SoundeR::AudioEmitter::AudioEmitter.PlaySoundAtPosition(AudioCollectionAsset collection, Vector3 worldPosition, int index, bool attachToParent)
+        { RngClass::DoNotTamper, SIG("36 05 00 00 80 78 1C 00 75 0A"), 34 }, // AudioSource SoundeR::AudioEmitter::AudioEmitter.PlaySoundAtPosition(AudioCollectionAsset collection, Vector3 worldPosition, int index, bool attachToParent)
+        { RngClass::DoNotTamper, SIG("EB 2B F3 44 0F 10 84 24 90 00 00 00"), -4 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.Refresh()
+        { RngClass::DoNotTamper, SIG("EB 2F F3 0F 10 BC 24 90 00 00 00"), -4 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.Refresh()
+        { RngClass::DoNotTamper, SIG("44 0F 28 D8 E9 80 00 00 00"), -4 }, // bool FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.AddGroupItems()
+        { RngClass::DoNotTamper, SIG("44 0F 28 D8 EB 3A"), -4 }, // bool FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.AddGroupItems()
+        { RngClass::DoNotTamper, SIG("44 0F 28 D0 E9 80 00 00 00"), -4 }, // bool FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.AddGroupItems()
+        { RngClass::DoNotTamper, SIG("44 0F 28 D0 EB 3A"), -4 }, // bool FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.AddGroupItems()
+        { RngClass::DoNotTamper, SIG("0F 28 F0 EB 69"), -4 }, // BuildVolumeSpots FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetSpot()
+        { RngClass::DoNotTamper, SIG("0F 28 F0 EB 38"), -4 }, // BuildVolumeSpots FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetSpot()
+        { RngClass::DoNotTamper, SIG("1E F3 0F 10 49 04"), 14 }, // float FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetRegionNextValue()
+        { RngClass::DoNotTamper, SIG("44 0F 28 C0 EB 3A"), -4 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS()
+        { RngClass::DoNotTamper, SIG("0F 28 F8 EB 39"), -4 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS()
+        { RngClass::DoNotTamper, SIG("0F 29 B4 24 C0 00 00 00 89"), 48 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS()
+        { RngClass::DoNotTamper, SIG("75 1D F3 0F 10 4B 60"), 22 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS()
+        { RngClass::DoNotTamper, SIG("75 1D F3 0F 10 4B 6C"), 22 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS()
+        { RngClass::DoNotTamper, SIG("75 1D F3 0F 10 4B 78"), 22 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS()
+        { RngClass::DoNotTamper, SIG("75 23 F3 0F 10 8B B0 00 00 00"), 28 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS()
+        { RngClass::DoNotTamper, SIG("75 23 F3 0F 10 8B BC 00 00 00"), 28 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS()
+        { RngClass::DoNotTamper, SIG("75 20 F3 0F 10 8B C8 00 00 00"), 25 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS()
+        { RngClass::DoNotTamper, SIG("75 0D F3 0F 10 4D 8B"), 11 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS630()
+        { RngClass::DoNotTamper, SIG("75 46 F3 0F 10 4D 9B"), 11 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS630()
+        { RngClass::DoNotTamper, SIG("F3 0F 11 46 08 66"), -11 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS630()
+        { RngClass::DoNotTamper, SIG("F3 0F 11 07 66 0F 7F 75 B7"), -11 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS630()
+        { RngClass::DoNotTamper, SIG("F3 0F 11 47 04 66"), -11 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS630()
+        { RngClass::DoNotTamper, SIG("F3 0F 11 47 08 66"), -11 }, // void FluffyUnderware::Curvy::Generator::Modules::BuildVolumeSpots::BuildVolumeSpots.GetTRS630()
     };
 
-    for (auto& sigScan : _sigScans1) {
-        _memory->AddSigScan(sigScan.scanHex, [&sigScan](int64_t offset, int index, const std::vector<uint8_t>& data) {
-            sigScan.foundAddress = offset + index + sigScan.offsetFromScan;
-            sigScan.targetFunction = Memory::ReadStaticInt(offset, index + sigScan.offsetFromScan, data);
-        });
-    }
-    for (auto& sigScan : _sigScans2) {
-        _memory->AddSigScan(sigScan.scanHex, [&sigScan](int64_t offset, int index, const std::vector<uint8_t>& data) {
-            sigScan.foundAddress = offset + index + sigScan.offsetFromScan;
-            sigScan.targetFunction = Memory::ReadStaticInt(offset, index + sigScan.offsetFromScan, data);
-        });
+    // The tables are parsed (and checked) by the compiler. Only the found addresses are filled in at runtime, by ResolveRngFunctions.
+    _sigScans1.assign(std::begin(s_sigScans1), std::end(s_sigScans1));
+    _sigScans2.assign(std::begin(s_sigScans2), std::end(s_sigScans2));
+    _sigScans3.assign(std::begin(s_sigScans3), std::end(s_sigScans3));
+
+    _rngScans.clear();
+    for (auto* sigScans : {&_sigScans1, &_sigScans2, &_sigScans3}) {
+        for (const auto& sigScan : *sigScans) {
+            _rngScans.push_back(_memory->AddSigScan(sigScan.signature, Memory::SigScanScope::Process));
+        }
     }
-    for (auto& sigScan : _sigScans3) {
-        _memory->AddSigScan(sigScan.scanHex, [&sigScan](int64_t offset, int index, const std::vector<uint8_t>& data) {
-            sigScan.foundAddress = offset + index + sigScan.offsetFromScan;
-            sigScan.targetFunction = Memory::ReadStaticInt(offset, index + sigScan.offsetFromScan, data);
-        });
+
+    // The icall names are found in the same pass. See FindIcallRngSlots
+    for (size_t i = 0; i < std::size(s_rngIcalls); i++) {
+        std::string_view name = s_rngIcalls[i];
+        _icallNameScans[i] = _memory->AddSigScanAll({name.data(), name.data() + name.size() + 1}, Memory::SigScanScope::Process);
     }
+}
 
-    size_t numFailedScans = _memory->ExecuteSigScans();
-    if (numFailedScans != 0) return false; // Sigscans failed, we'll try again later.
+bool Trainer::ResolveRngFunctions() {
+    // _rngScans follows the order of the tables. The call at each site is read from the original code, since a restored feature has already redirected it.
+    auto rngScan = _rngScans.begin();
+    for (auto* sigScans : {&_sigScans1, &_sigScans2, &_sigScans3}) {
+        for (auto& sigScan : *sigScans) {
+            const Memory::SigScanHandle& handle = *rngScan++;
+            if (!handle.Found()) return false;
+            sigScan.foundAddress = handle.Address() + sigScan.offsetFromScan;
+            std::vector<byte> call = _memory->ReadOriginalCode(sigScan.foundAddress - 1, 5); // [opcode, rel32]
+            if (call.size() != 5) return false;
+            sigScan.callOpcode = call[0];
+            sigScan.targetFunction = Memory::ReadStaticInt(sigScan.foundAddress - 1, 1, call);
+        }
+    }
 
     // Double check that each group of sigscans hits the same target function (i.e. verifying the AOB and offsets are still lining up)
     // This also prevents re-randomization.
-    for (const auto& sigScan : _sigScans1) {
-        if (sigScan.targetFunction != _sigScans1[0].targetFunction) return false;
-    }
-    for (const auto& sigScan : _sigScans2) {
-        if (sigScan.targetFunction != _sigScans2[0].targetFunction) return false;
-    }
-    for (const auto& sigScan : _sigScans3) {
-        if (sigScan.targetFunction != _sigScans3[0].targetFunction) return false;
+    for (auto* sigScans : {&_sigScans1, &_sigScans2, &_sigScans3}) {
+        for (const auto& sigScan : *sigScans) {
+            if (sigScan.targetFunction != (*sigScans)[0].targetFunction) return false;
+        }
     }
 
     return true;
 }
 
-void Trainer::OverwriteRngFunctions() {
+void Trainer::OverwriteRngFunctions(Memory::PatchTransaction& patch) {
     __int64 randomIntRange = _sigScans2[0].targetFunction; // UnityEngine::Random::Random.Range(int minInclusive, int maxExclusive) => [min, max)
-    _memory->WriteData<byte>({randomIntRange}, {
+    patch.Write("Derandomize", randomIntRange, {
         0x41, 0xB0, 0x00,                                           // mov r8b, 0                   ; RngClass.Unknown
         SKIP(0x41, 0xB0, 0x01),                                     // mov r8b, 1                   ; RngClass.DoNotTamper
         SKIP(0x41, 0xB0, 0x02),                                     // mov r8b, 2                   ; RngClass.BirdPathing
@@ -382,12 +721,11 @@ void Trainer::OverwriteRngFunctions() {
     });
 
     for (const auto& sigScan : _sigScans2) {
-        // TODO: Explain math.
-        _memory->WriteData<int>({sigScan.foundAddress}, {(int)(sigScan.targetFunction - sigScan.foundAddress - 4 + 5 * sigScan.rngClass)});
+        RedirectRngCallSite(patch, sigScan);
     }
 
     __int64 randomFloatRange = _sigScans3[0].targetFunction; // UnityEngine::Random::Random.Range(float minInclusive, float maxInclusive) => [min, max]
-    _memory->WriteData<byte>({randomFloatRange}, {
+    patch.Write("Derandomize", randomFloatRange, {
         0x41, 0xB0, 0x00,                                           // mov r8b, 0                   ; RngClass.Unknown
         SKIP(0x41, 0xB0, 0x01),                                     // mov r8b, 1                   ; RngClass.DoNotTamper
         SKIP(0x41, 0xB0, 0x02),                                     // mov r8b, 2                   ; RngClass.BirdPathing
@@ -399,16 +737,16 @@ void Trainer::OverwriteRngFunctions() {
         SKIP(0x41, 0xB0, 0x08),                                     // mov r8b, 8                   ; RngClass.Derigiblock
         SKIP(0x41, 0xB0, 0x09),                                     // mov r8b, 9                   ; RngClass.SlotMachine
 
-        0x48, 0xB8, LONG_TO_BYTES(_floatRngFunction),               // mov rax, _floatRngFunction   ; Load the address of the generic floating-point function, after RngClass is set
+        0x48, 0xB8, LONG_TO_BYTES(_floatRngFunction + s_floatRangeEntry), // mov rax, floatRangeEntry ; Load the address of the generic floating-point function, after RngClass is set
         0xFF, 0xE0,                                                 // jmp rax                      ; Jump to it (tail call elision)
     });
 
     for (const auto& sigScan : _sigScans3) {
-        _memory->WriteData<int>({sigScan.foundAddress}, {(int)(sigScan.targetFunction - sigScan.foundAddress - 4 + 5 * sigScan.rngClass)});
+        RedirectRngCallSite(patch, sigScan);
     }
 
     __int64 randomValue = _sigScans1[0].targetFunction; // UnityEngine::Random::Random.value => [0.0, 1.0]
-    _memory->WriteData<byte>({randomValue}, {
+    patch.Write("Derandomize", randomValue, {
         0x41, 0xB0, 0x00,                                           // mov r8b, 0                   ; RngClass.Unknown
         SKIP(0x41, 0xB0, 0x01),                                     // mov r8b, 1                   ; RngClass.DoNotTamper
         SKIP(0x41, 0xB0, 0x02),                                     // mov r8b, 2                   ; RngClass.BirdPathing
@@ -420,42 +758,220 @@ void Trainer::OverwriteRngFunctions() {
         SKIP(0x41, 0xB0, 0x08),                                     // mov r8b, 8                   ; RngClass.Derigiblock
         SKIP(0x41, 0xB0, 0x09),                                     // mov r8b, 9                   ; RngClass.SlotMachine
 
-        0x48, 0x83, 0xEC, 0x10,                                     // sub rsp, 0x10                ; Allocate space for our local variables, while staying fpu aligned
-        0xC7, 0x44, 0x24, 0x00, INT_TO_BYTES(0x00000000),           // mov dword ptr [rsp], 0.0f	; Store a float on the stack (floats cannot be handled as immediate values)
-        0xF3, 0x0F, 0x10, 0x04, 0x24,                               // movss xmm0, [rsp]            ; Move the float into xmm0
-        0xC7, 0x44, 0x24, 0x00, INT_TO_BYTES(0x3f800000),           // mov dword ptr [rsp], 1.0f	; Store a float on the stack (floats cannot be handled as immediate values)
-        0xF3, 0x0F, 0x10, 0x0C, 0x24,                               // movss xmm1, [rsp]            ; Move the float into xmm1
-        0x48, 0x83, 0xC4, 0x10,                                     // add rsp, 10                  ; Restore the stack pointer (freeing our local variables)
-        0x48, 0xB8, LONG_TO_BYTES(_floatRngFunction),               // mov rax, _floatRngFunction   ; Load the address of the generic floating-point function, after RngClass is set
+        0x48, 0xB8, LONG_TO_BYTES(_floatRngFunction),               // mov rax, _floatRngFunction   ; Load the [0.0, 1.0] entry point of the floating-point function, after RngClass is set
         0xFF, 0xE0,                                                 // jmp rax                      ; Jump to it (tail call elision)
     });
 
     for (const auto& sigScan : _sigScans1) {
-        _memory->WriteData<int>({sigScan.foundAddress}, {(int)(sigScan.targetFunction - sigScan.foundAddress - 4 + 5 * sigScan.rngClass)});
+        RedirectRngCallSite(patch, sigScan);
+    }
+}
+
+void Trainer::RedirectRngCallSite(Memory::PatchTransaction& patch, const SigScanTemplate& sigScan) {
+    // Redirect each call into its counting stub, or else directly into the 'mov r8b, rngClass' for its category (each of which is 5 bytes long).
+    // The whole instruction is rewritten, so that the patch starts on an instruction boundary.
+    __int64 target = sigScan.targetFunction + 5 * sigScan.rngClass;
+    if (sigScan.callSiteStub != 0) target = sigScan.callSiteStub;
+    int rel32 = (int)(target - sigScan.foundAddress - 4);
+    patch.Write("Derandomize", sigScan.foundAddress - 1, {sigScan.callOpcode, INT_TO_BYTES(rel32)});
+}
+
+void Trainer::FindIcallRngSlots() {
+    // Some callers reach the RNG through an IL2CPP internal call, which is looked up by name on first use and then cached in a static:
+    //   v95 = qword_18318CDC8;
+    //   if (!qword_18318CDC8) {
+    //     v95 = il2cpp_resolve_icall_0("UnityEngine.Random::RandomRangeInt(System.Int32,System.Int32)");
+    //     qword_18318CDC8 = v95;
+    //   }
+    //   v96 = v95(0, v94); // <-- actual function call here
+    // Every inlined copy of the wrapper shares the same cache slot, so pointing the slot at our own stub covers all of them
+    // (and the game never resolves it). Since the callers don't pass a category, the stub looks it up from its return address.
+    _icallSlots.clear();
+
+    // The names (including their null terminators) were found by the attach scan. Now find every 'lea rcx, [rip + name]' which passes one
+    // to il2cpp_resolve_icall. This needs a second pass, since we can't know which references we want until we know where the names are.
+    std::vector<uintptr_t> allNames;
+    for (const auto& scan : _icallNameScans) allNames.insert(allNames.end(), scan.Addresses().begin(), scan.Addresses().end());
+    auto references = _memory->FindRipRelativeReferences({0x48, 0x8D, 0x0D}, allNames);
+
+    for (size_t i = 0; i < std::size(s_rngIcalls); i++) {
+        // The resolved pointer is stored into the slot shortly after the lookup, with a 'mov qword ptr [rip + slot], rax'.
+        std::map<__int64, std::vector<__int64>> callersBySlot;
+        for (uintptr_t name : _icallNameScans[i].Addresses()) {
+            for (uintptr_t reference : references[name]) {
+                std::vector<byte> code = _memory->ReadDataAcrossPages<byte>({static_cast<__int64>(reference)}, s_icallStoreDistance);
+                for (__int64 j = 7; j + 7 <= s_icallStoreDistance; j++) {
+                    if (code[j] != 0x48 || code[j + 1] != 0x89 || code[j + 2] != 0x05) continue;
+                    callersBySlot[Memory::ReadStaticInt(reference, static_cast<int>(j + 3), code)].push_back(reference);
+                    break;
+                }
+            }
+        }
+        if (callersBySlot.empty()) DebugPrint(std::string("No icall cache slots found for ") + s_rngIcalls[i]);
+
+        for (const auto& [slot, callers] : callersBySlot) {
+            IcallSlot icallSlot{i, slot};
+            for (__int64 reference : callers) {
+                // The bounds of the calling function come from the int3 padding between functions. This spans several pages.
+                std::vector<byte> code = _memory->ReadDataAcrossPages<byte>({reference - s_maxFunctionSize}, 2 * s_maxFunctionSize);
+                __int64 start = reference - s_maxFunctionSize;
+                __int64 end = reference + s_maxFunctionSize;
+                for (__int64 j = s_maxFunctionSize; j >= 2; j--) {
+                    if (code[j - 1] == 0xCC && code[j - 2] == 0xCC) { start = reference - s_maxFunctionSize + j; break; }
+                }
+                for (__int64 j = s_maxFunctionSize; j + 1 < 2 * s_maxFunctionSize; j++) {
+                    if (code[j] == 0xCC && code[j + 1] == 0xCC) { end = reference - s_maxFunctionSize + j; break; }
+                }
+                icallSlot.callers.push_back({start, end, RngClass::Unknown});
+            }
+            _icallSlots.push_back(std::move(icallSlot));
+        }
+    }
+}
+
+void Trainer::ClassifyIcallRngCallers() {
+    // The category of a caller comes from the direct call sites in the same function.
+    for (auto& icallSlot : _icallSlots) {
+        for (auto& caller : icallSlot.callers) {
+            for (auto* sigScans : {&_sigScans1, &_sigScans2, &_sigScans3}) {
+                for (const auto& sigScan : *sigScans) {
+                    if (caller.rngClass == RngClass::Unknown && sigScan.foundAddress >= caller.start && sigScan.foundAddress < caller.end) caller.rngClass = sigScan.rngClass;
+                }
+            }
+        }
     }
 }
 
-void Trainer::InjectDraftWatcher() {
-    int64_t pickRoomFromSlot = 0;
-    int64_t pickTop = 0;
-    _memory->AddSigScan("48 8B 4C C1 20 48 85 C9 74 1D 45", [&](int64_t offset, int index, const std::vector<uint8_t>& data) {
-        pickRoomFromSlot = offset + index;
-        pickTop = Memory::ReadStaticInt(offset, index + 0x10, data);
+void Trainer::RedirectIcallRngSlots(Memory::PatchTransaction& patch) {
+    const __int64 kernels[] = {_intRngFunction, _floatRngFunction + s_floatRangeEntry, _floatRngFunction};
+    static_assert(std::size(kernels) == std::size(s_rngIcalls));
+
+    std::vector<byte> stubs;
+    std::vector<std::pair<__int64, size_t>> slotStubs; // [slot, offset of its stub]
+    for (const auto& icallSlot : _icallSlots) {
+        slotStubs.emplace_back(icallSlot.slot, stubs.size());
+        stubs.insert(stubs.end(), {
+            0x4C, 0x8B, 0x1C, 0x24,                                 // mov r11, qword ptr [rsp]     ; Load our return address (which identifies the caller)
+            0x41, 0xB0, RngClass::Unknown,                          // mov r8b, 0                   ; RngClass.Unknown, unless the caller is recognized
+        });
+        for (const auto& caller : icallSlot.callers) {
+            if (caller.rngClass == RngClass::Unknown) continue;
+            __int64 start = caller.start;
+            stubs.insert(stubs.end(), {
+                0x49, 0xBA, LONG_TO_BYTES(start),                   // mov r10, start               ; Load the start of the calling function
+                0x4D, 0x89, 0xD9,                                   // mov r9, r11                  ;
+                0x4D, 0x29, 0xD1,                                   // sub r9, r10                  ; Compute the offset of the return address into the function
+                IF_LT(0x49, 0x81, 0xF9, INT_TO_BYTES(caller.end - caller.start)), // cmp r9, size   ; (unsigned, so return addresses before the function are also out of range)
+                THEN(                                               //                              ; if (offset < size) {
+                    0x41, 0xB0, caller.rngClass                     // mov r8b, rngClass            ;   Use the category of this caller
+                ),                                                  //                              ; }
+            });
+        }
+        __int64 kernel = kernels[icallSlot.icall];
+        stubs.insert(stubs.end(), {
+            0x48, 0xB8, LONG_TO_BYTES(kernel),                      // mov rax, kernel              ; Load the address of the RNG kernel for this icall
+            0xFF, 0xE0,                                             // jmp rax                      ; Jump to it (tail call elision)
+        });
+    }
+    if (stubs.empty()) return;
+
+    __int64 icallStubs = _memory->AllocateArray(stubs.size());
+    _memory->AddFeatureAllocation("Derandomize", icallStubs);
+    if (_memory->WriteDataAcrossPages<byte>({icallStubs}, stubs) != stubs.size()) {
+        assert(false, "Failed to write the RNG icall stubs");
+        return; // Leave the slots alone, rather than point them at a partial stub
+    }
+    for (const auto& [slot, stubOffset] : slotStubs) {
+        __int64 stub = icallStubs + stubOffset;
+        patch.Write("Derandomize", slot, {LONG_TO_BYTES(stub)}); // Slots are aligned, so this is a single atomic write
+    }
+}
+
+Trainer::RngCounters Trainer::PollRngCounters() {
+    RngCounters counters;
+    if (_rngSeedArray == 0) return counters;
+
+    // The class and call site counters are adjacent, so we can read them all at once.
+    std::vector<uint64_t> data = _memory->ReadData<uint64_t>({GetRngClassCounters()}, RngClass::NumEntries + _numRngCallSites);
+    auto now = std::chrono::steady_clock::now();
+    counters.classDraws.assign(data.begin(), data.begin() + RngClass::NumEntries);
+    counters.callSiteDraws.assign(data.begin() + RngClass::NumEntries, data.end());
+
+    counters.classDrawsPerSecond.resize(RngClass::NumEntries, 0.0);
+    std::lock_guard<std::mutex> l(_rngCountersMutex);
+    double elapsed = std::chrono::duration<double>(now - _lastRngPoll).count();
+    if (_lastRngClassDraws.size() == RngClass::NumEntries && elapsed > 0.0) {
+        for (int i = 0; i < RngClass::NumEntries; i++) {
+            // The counters start over when the game restarts.
+            if (counters.classDraws[i] < _lastRngClassDraws[i]) continue;
+            counters.classDrawsPerSecond[i] = (counters.classDraws[i] - _lastRngClassDraws[i]) / elapsed;
+        }
+    }
+    _lastRngClassDraws = counters.classDraws;
+    _lastRngPoll = now;
+    return counters;
+}
+
+void Trainer::DeclareDraftWatcherScans() {
+    _getRoomByName = 0;
+    constexpr Signature pickRoomFromSlot = SIG("48 8B 4C C1 20 48 85 C9 74 1D 45");
+    constexpr Signature getRoomByName = SIG("75 29 48 8B 4B 10");
+    _pickRoomFromSlotScan = _memory->AddSigScan(pickRoomFromSlot, Memory::SigScanScope::Process, [this](int64_t offset, int index, const std::vector<uint8_t>& data) {
+        _pickTop = Memory::ReadStaticInt(offset, index + 0x10, data);
     });
-    int64_t getRoomByName = 0;
-    int64_t createCard = 0;
-    _memory->AddSigScan("75 29 48 8B 4B 10", [&](int64_t offset, int index, const std::vector<uint8_t>& data) {
-        getRoomByName = Memory::ReadStaticInt(offset, index + 0x16, data);
-        createCard = Memory::ReadStaticInt(offset, index + 0x24, data);
+    _getRoomByNameScan = _memory->AddSigScan(getRoomByName, Memory::SigScanScope::Process, [this](int64_t offset, int index, const std::vector<uint8_t>& data) {
+        _getRoomByName = Memory::ReadStaticInt(offset, index + 0x16, data);
+        _createCard = Memory::ReadStaticInt(offset, index + 0x24, data);
     });
+}
 
-    size_t numFailedScans = _memory->ExecuteSigScans();
-    assert(numFailedScans == 0, "Failed to find scan for PickRoomFromSlot");
+bool Trainer::ResolveDraftWatcher() {
+    _pickRoomFromSlot = _pickRoomFromSlotScan.Address();
+    bool found = (_pickRoomFromSlotScan.Found() && _getRoomByNameScan.Found());
+    assert(found, "Failed to find scan for PickRoomFromSlot");
+    if (!found) return false;
+    _memory->SetJournalValue("PickRoomFromSlot", "GetRoomByName", _getRoomByName);
+    return true;
+}
 
-    _buffer = _memory->AllocateArray(0x1'000'000); // This is *way* too big, but what the hell ever. We can afford to allocate 1MB to avoid having to think about running out of buffer space.
-    _memory->WriteData<int64_t>({(__int64)_buffer}, {_bufferPosition}); // Write initial size to skip past the reserved initial spots
+void Trainer::AllocateDraftBuffer() {
+    _buffer = _memory->AllocateArray(s_bufferSize); // This is *way* too big, but what the hell ever. We can afford to allocate 1MB to avoid having to think about running out of buffer space.
+    _memory->AddFeatureAllocation("PickRoomFromSlot", _buffer);
+    {
+        std::lock_guard<std::mutex> l(_decksMutex);
+        _bufferPosition = s_bufferHeaderSize;
+        _bufferFull = false;
+    }
+    _memory->WriteData<int64_t>({(__int64)_buffer}, {s_bufferHeaderSize}); // Write initial size to skip past the reserved initial spots
+    _memory->SetJournalValue("PickRoomFromSlot", "Buffer", _buffer);
+    _memory->SetJournalValue("PickRoomFromSlot", "BufferLayout", s_bufferLayout);
+}
 
-    _memory->Intercept("PickRoomFromSlot", pickRoomFromSlot, pickRoomFromSlot + 20, {
+bool Trainer::RestoreDraftWatcher() {
+    // The name table is laid out for the room names of the trainer which wrote it.
+    if (_memory->GetJournalValue("PickRoomFromSlot", "RoomNameTableSize") != static_cast<uint64_t>(_roomNameTableSize)) {
+        DebugPrint("The journaled room names were written by a different version of the trainer");
+        return false;
+    }
+    if (_memory->GetJournalValue("PickRoomFromSlot", "BufferLayout") != s_bufferLayout) {
+        DebugPrint("The journaled draft hook was written by a different version of the trainer");
+        return false;
+    }
+    _buffer = _memory->GetJournalValue("PickRoomFromSlot", "Buffer");
+    _roomNameTable = _memory->GetJournalValue("PickRoomFromSlot", "RoomNameTable");
+    if (_buffer == 0) return false;
+    std::lock_guard<std::mutex> l(_decksMutex);
+    _bufferPosition = _memory->ReadData<int64_t>({_buffer}, 1)[0]; // Skip past any decks the previous trainer already read
+    _bufferFull = false;
+    return true;
+}
+
+void Trainer::InjectDraftWatcher(Memory::PatchTransaction& patch) {
+    const __int64 getRoomByName = _getRoomByName;
+    const __int64 createCard = _createCard;
+    const __int64 pickTop = _pickTop;
+    const int32_t bufferSize = static_cast<int32_t>(s_bufferSize);
+    _memory->Intercept(patch, "PickRoomFromSlot", _pickRoomFromSlot, _pickRoomFromSlot + 20, {
         0x51,                                       // push rcx                             ;
         0x52,                                       // push rdx                             ;
         0x56,                                       // push rsi                             ;
@@ -468,34 +984,39 @@ void Trainer::InjectDraftWatcher() {
         0x41, 0x55,                                 // push r13                             ;
         0x41, 0x56,                                 // push r14                             ;
         0x41, 0x57,                                 // push r15                             ; Push a bunch of registers so we're free to use r8-15 as needed.
+        0x45, 0x31, 0xE4,                           // xor r12d,r12d                        ; r12 = 0 (the new buffer size, once we have written a deck)
         0x48, 0x8B, 0x4C, 0xC1, 0x20,               // mov rcx,qword ptr ds:[rcx+rax*8+20]  ; rcx = RoomDeck (This is the computation the game uses to determine the correct deck.)
         0x4C, 0x8B, 0x41, 0x20,                     // mov r8,qword ptr ds:[rcx+10]         ; r8 = RoomDeck.FilteredDeck
         0x45, 0x8B, 0x48, 0x18,                     // mov r9d,qword ptr ds:[r8+18]         ; r9d = List<RoomCard>._size
+        0x49, 0xBF, LONG_TO_BYTES(_buffer),         // mov r15,_buffer                      ; r15 = _buffer (a shared memory buffer, we will read from here when the game is done choosing decks
+        0x4D, 0x8B, 0x2F,                           // mov r13,qword ptr ds:[r15]           ; r13 = [r15] (the current buffer size)
+        0x4F, 0x8D, 0x5C, 0xCD, 0x20,               // lea r11,qword ptr ds:[r13+r9*8+20]   ; r11 = the buffer size after this draft: [slot, templates..., null, override, drawn]
+        IF_GT(0x49, 0x81, 0xFB, INT_TO_BYTES(bufferSize)), // cmp r11,bufferSize            ;
+        THEN(                                       // if (r11 > bufferSize) {              ; if (r11 > bufferSize) { (the buffer is full)
+          0x49, 0xFF, 0x47, 0x28,                   //   inc qword ptr ds:[r15+28]          ;   _buffer[5]++ (count the dropped draft, so that the trainer can tell)
+          0x45, 0x31, 0xC9                          //   xor r9d,r9d                        ;   r9d = 0 (do not write this deck)
+        ),                                          // }                                    ; }
         IF_GT(0x45, 0x85, 0xC9),                    // test r9d,r9d                         ;
         THEN(                                       // if (r9d > 0) {                       ; if (r9d > 0) {
           0x4D, 0x8B, 0x50, 0x10,                   //   mov r10,qword ptr ds:[r8+10]       ;   r10 = List<RoomCard>._items
           0x49, 0x83, 0xC2, 0x20,                   //   add r10,20                         ;   r10 = &_items.vector (the actual data pointer inside a List<T>)
-          0x49, 0xBF, LONG_TO_BYTES(_buffer),       //   mov r15,_buffer                    ;   r15 = _buffer (a shared memory buffer, we will read from here when the game is done choosing decks
-          0x4D, 0x03, 0x3F,                         //   add r15,qword ptr ds:[r15]         ;   r15 += [r15] (adjust forward to account for the current buffer size)
+          0x4D, 0x01, 0xEF,                         //   add r15,r13                        ;   r15 += r13 (adjust forward to account for the current buffer size)
+          0x4C, 0x8B, 0x9C, 0x24, INT_TO_BYTES(0x1A0),// mov r11,qword ptr ss:[rsp+1A0]     ;   r11 = [rsp + 0x1A0] (saved stack value of RoomDraftContext)
+          0x45, 0x8B, 0x5B, 0x40,                   //   mov r11d,qword ptr ds:[r11+40]     ;   r11 = RoomDraftContext.CurrentSlot
+          0x4D, 0x89, 0x1F,                         //   mov qword ptr ds:[r15],r11         ;   [r15] = r11 (write the slot which is being drafted, ahead of its deck)
+          0x49, 0x83, 0xC7, 0x08,                   //   add r15,8                          ;   r15 += 8
           DO_WHILE_NONZERO(                         //   do {                               ;   Iterate over all the cards
             0x4D, 0x8B, 0x1A,                       //     mov r11,qword ptr ds:[r10]       ;     r11 = [r10] (This loads the item at index r9, which is directly pointed to by r10)
             0x4D, 0x8B, 0x5B, 0x10,                 //     mov r11,qword ptr ds:[r11+10]    ;     r11 = RoomCard.Template
-            0x4D, 0x8B, 0x5B, 0x48,                 //     mov r11,qword ptr ds:[r11+48]    ;     r11 = RoomTemplate.Headline
-            0x49, 0x83, 0xC3, 0x14,                 //     add r11,14                             r11 = &Headline._firstChar
-            DO_WHILE_NONZERO(                       //     do {                             ;     Iterate over all the chars
-              0x66, 0x45, 0x8B, 0x23,               //       mov r12w,word ptr ds:[r11]     ;       r12w = [r11] (dereferencing the wide character in the string)
-              0x66, 0x45, 0x89, 0x27,               //       mov word ptr ds:[r15],r12w     ;       [r15] = r12w (write the wide character into the buffer)
-              0x49, 0x83, 0xC3, 0x02,               //       add r11,2                      ;       r11 += 2 (adjust the string by one wide character)
-              0x49, 0x83, 0xC7, 0x02,               //       add r15,2                      ;       r15 += 2 (adjust the buffer pointer by one wide character)
-              0x66, 0x45, 0x85, 0xE4                //       test r12w,r12w                 ;       check if we reached a null terminator
-            ),                                      //     }                                ;     (done copying string)
+            0x4D, 0x89, 0x1F,                       //     mov qword ptr ds:[r15],r11       ;     [r15] = r11 (write the template pointer into the buffer; the trainer looks up its name)
+            0x49, 0x83, 0xC7, 0x08,                 //     add r15,8                        ;     r15 += 8 (adjust the buffer pointer by one template)
             0x49, 0x83, 0xC2, 0x08,                 //     add r10,8                        ;     r10 += 8 (increment to the next card in the list)
             0x41, 0xFF, 0xC9                        //     dec r9d                          ;     r9d-- (decrement the number of cards remaining)
           ),                                        //   }                                  ;   (done iterating through cards)
-          0x49, 0x83, 0xC7, 0x02,                   //   add r15,2                          ;   r15 += 2 (add a null terminator to indicate end of a deck)
+          0x49, 0x83, 0xC7, 0x08,                   //   add r15,8                          ;   r15 += 8 (add a null template to indicate end of a deck)
           0x49, 0xBE, LONG_TO_BYTES(_buffer),       //   mov r14,_buffer                    ;   r14 = _buffer
           0x4D, 0x29, 0xF7,                         //   sub r15,r14                        ;   r15 -= r14 (compute the delta from the end of the buffer)
-          0x4D, 0x89, 0x3E                          //   mov qword ptr ds:[r14],r15         ;   [r14] = r15 (write back the current buffer size)
+          0x4D, 0x89, 0xFC                          //   mov r12,r15                        ;   r12 = r15 (the buffer size is written back once we know which room was drawn)
         ),                                          // }                                    ; }
                                                     //                                      ;
                                                     //                                      ; This interception is not writing back the original code. As a result, we must handle it here.
@@ -503,17 +1024,26 @@ void Trainer::InjectDraftWatcher() {
                                                     //                                      ;
         0x49, 0xBF, LONG_TO_BYTES(_buffer),         // mov r15,_buffer                      ; r15 = _buffer (a shared memory buffer, we will read from here when the game is done choosing decks
         0x48, 0x8B, 0x8C, 0x24, INT_TO_BYTES(0x1A0),// mov rcx,qword ptr ss:[rsp+1A0]       ; rcx = [rsp + 0x1A0] (saved stack value of RoomDraftContext)
+        0x48, 0x8B, 0x49, 0x10,                     // mov rcx,qword ptr ds:[rcx+10]        ; rcx = RoomDraftContext.Database
+        0x49, 0x89, 0x4F, 0x20,                     // mov qword ptr ds:[r15+20],rcx        ; _buffer[4] = rcx (so that the trainer can look up room templates itself)
+        0x48, 0x8B, 0x8C, 0x24, INT_TO_BYTES(0x1A0),// mov rcx,qword ptr ss:[rsp+1A0]       ; rcx = [rsp + 0x1A0] (saved stack value of RoomDraftContext)
         0x8B, 0x49, 0x40,                           // mov ecx,qword ptr ds:[rcx+40]        ; ecx = RoomDraftContext.CurrentSlot
         0x4D, 0x8D, 0x3C, 0xCF,                     // lea r15,qword ptr ds:[r15+rcx*8]     ; r15 += rcx*8 (r15 = _buffer[currentSlot * 8])
         0x4D, 0x8B, 0x37,                           // mov r14,qword ptr ds:[r15]           ; r14 = [r15] (check to see if there's a card override at this slot)
+        0x4D, 0x89, 0xF5,                           // mov r13,r14                          ; r13 = r14 (the override as we read it, for the draft record)
         IF_NZ(0x4D, 0x85, 0xF6),                    // test r14,r14                         ;
         THEN(                                       // if (r14 != 0) {                      ; if (r14 != 0) {
-          0x48, 0x8B, 0x8C, 0x24, INT_TO_BYTES(0x1A0),// mov rcx,qword ptr ss:[rsp+1A0]     ;   rcx = [rsp + 0x1A0] (saved stack value of RoomDraftContext)
-          0x48, 0x8B, 0x49, 0x10,                   //   mov rcx,qword ptr ds:[rcx+10]      ;   rcx = RoomDraftContext.Database
-          0x4C, 0x89, 0xF2,                         //   mov rdx,r14                        ;   rdx = r14 (our room name)
-          0x49, 0xBB, LONG_TO_BYTES(getRoomByName), //   mov r11,getRoomByName              ;   r11 = &RoomDatabase.GetRoomByName
-          0x41, 0xFF, 0xD3,                         //   call r11                           ;   RoomTemplate rax = RoomDatabase.GetRoomByName(database, name);
-          IF_NZ(0x48, 0x85, 0xC0),                  //   test rax,rax                       ;   
+          0x4C, 0x89, 0xF0,                         //   mov rax,r14                        ;   rax = r14 (usually, the trainer has already resolved the RoomTemplate)
+          IF_NZ(0x41, 0xF6, 0xC6, 0x01),            //   test r14b,1                        ;
+          THEN(                                     //   if (r14 & 1) {                     ;   if (r14 & 1) { (a tagged room name, because the trainer did not know the database yet)
+            0x49, 0x83, 0xE6, 0xFE,                 //     and r14,FFFFFFFFFFFFFFFE         ;     r14 &= ~1 (our room name)
+            0x48, 0x8B, 0x8C, 0x24, INT_TO_BYTES(0x1A0),// mov rcx,qword ptr ss:[rsp+1A0]   ;     rcx = [rsp + 0x1A0] (saved stack value of RoomDraftContext)
+            0x48, 0x8B, 0x49, 0x10,                 //     mov rcx,qword ptr ds:[rcx+10]    ;     rcx = RoomDraftContext.Database
+            0x4C, 0x89, 0xF2,                       //     mov rdx,r14                      ;     rdx = r14 (our room name)
+            0x49, 0xBB, LONG_TO_BYTES(getRoomByName), //   mov r11,getRoomByName            ;     r11 = &RoomDatabase.GetRoomByName
+            0x41, 0xFF, 0xD3                        //     call r11                         ;     RoomTemplate rax = RoomDatabase.GetRoomByName(database, name);
+          ),                                        //   }                                  ;   }
+          IF_NZ(0x48, 0x85, 0xC0),                  //   test rax,rax                       ;
           THEN(                                     //   if (rax != 0) {                    ;   if (rax != 0) {
             0x48, 0x8B, 0x8C, 0x24, INT_TO_BYTES(0x1A0),// mov rcx,qword ptr ss:[rsp+1A0]   ;     rcx = [rsp + 0x1A0] (saved stack value of RoomDraftContext)
             0x48, 0x89, 0xC2,                       //     mov rdx,rax                      ;     rdx = rax (pass the room template as arg 2)
@@ -537,6 +1067,20 @@ void Trainer::InjectDraftWatcher() {
             0x41, 0xFF, 0xD3                        //     call r11                         ;     rax = RoomDeck::PickTop(RoomDeck this, bool reshuffle)
           )                                         //   }                                  ;   }
         ),                                          // }                                    ; }
+        IF_NZ(0x4D, 0x85, 0xE4),                    // test r12,r12                         ;
+        THEN(                                       // if (r12 != 0) {                      ; if (r12 != 0) { (we wrote a deck above)
+          0x45, 0x31, 0xDB,                         //   xor r11d,r11d                      ;   r11 = 0 (no room was drawn)
+          IF_NZ(0x48, 0x85, 0xC0),                  //   test rax,rax                       ;
+          THEN(                                     //   if (rax != 0) {                    ;   if (rax != 0) {
+            0x4C, 0x8B, 0x58, 0x10                  //     mov r11,qword ptr ds:[rax+10]    ;     r11 = RoomCard.Template (of the card we are returning)
+          ),                                        //   }                                  ;   }
+          0x49, 0xBE, LONG_TO_BYTES(_buffer),       //   mov r14,_buffer                    ;   r14 = _buffer
+          0x4F, 0x89, 0x2C, 0x26,                   //   mov qword ptr ds:[r14+r12],r13     ;   [r14 + r12] = r13 (write the override we used after the deck's null terminator)
+          0x49, 0x83, 0xC4, 0x08,                   //   add r12,8                          ;   r12 += 8
+          0x4F, 0x89, 0x1C, 0x26,                   //   mov qword ptr ds:[r14+r12],r11     ;   [r14 + r12] = r11 (then the drawn room)
+          0x49, 0x83, 0xC4, 0x08,                   //   add r12,8                          ;   r12 += 8
+          0x4D, 0x89, 0x26                          //   mov qword ptr ds:[r14],r12         ;   [r14] = r12 (write back the current buffer size, which publishes the whole deck)
+        ),                                          // }                                    ; }
         0x41, 0x5F,                                 // pop r15                              ; Pop all our used registers to clean up.
         0x41, 0x5E,                                 // pop r14                              ;
         0x41, 0x5D,                                 // pop r13                              ;
@@ -552,78 +1096,204 @@ void Trainer::InjectDraftWatcher() {
     }, /*writeOriginalCode*/ false);
 }
 
-std::vector<wchar_t> Trainer::ReadBuffer() {
-    if (_buffer == 0) return {};
-    int64_t newBufferPosition = _memory->ReadData<int64_t>({_buffer}, {0x8})[0];
-    if (newBufferPosition == _bufferPosition) return {};
-    std::vector<wchar_t> rawChars = _memory->ReadData<wchar_t>({_buffer + _bufferPosition}, (newBufferPosition - _bufferPosition) / 2);
-    _bufferPosition = newBufferPosition;
-
-    return rawChars;
+bool Trainer::ReadBuffer() {
+    if (_buffer == 0) return false;
+    int64_t newBufferPosition = _memory->ReadData<int64_t>({_buffer}, 1)[0];
+    if (!_bufferFull && _memory->ReadData<int64_t>({_buffer + 0x28}, 1)[0] != 0) {
+        // The hook stops writing once the buffer is full. The decks we already have are still fine.
+        _bufferFull = true;
+        DebugPrint("The draft buffer is full, so later drafts will not be read");
+    }
+    if (newBufferPosition == _bufferPosition) return false;
+    if (newBufferPosition < _bufferPosition || newBufferPosition > s_bufferSize || newBufferPosition % 8 != 0) {
+        DebugPrint("Draft buffer position is invalid: " + std::to_string(newBufferPosition));
+        return false;
+    }
+    // The new decks usually span pages. Anything which could not be read is read again next time.
+    size_t numRead = _memory->ReadDataAcrossPages<uint64_t>({_buffer + _bufferPosition}, (newBufferPosition - _bufferPosition) / 8, _bufferTemplates);
+    _bufferTemplates.resize(numRead);
+    _bufferPosition += numRead * 8;
+    return numRead > 0;
 }
 
-std::vector<std::vector<std::wstring>> Trainer::GetDecks() {
-    std::vector<wchar_t> buffer = ReadBuffer();
-    size_t i = 0;
+const std::wstring& Trainer::GetRoomName(uint64_t roomTemplate) {
+    auto search = _roomNames.find(roomTemplate);
+    if (search != _roomNames.end()) return search->second;
 
-    std::vector<std::vector<std::wstring>> decks;
-    while (i < buffer.size()) {
-        std::vector<std::wstring> deck;
-        while (buffer[i] != L'\0') {
-            std::wstring card;
-            while (buffer[i] != L'\0') {
-                card.push_back(buffer[i]);
-                i++;
+    // RoomTemplate.Headline is a C# String: [vtable, monitor, int length, wchar_t chars[length]]
+    __int64 headline = _memory->ReadData<__int64>({static_cast<__int64>(roomTemplate) + 0x48}, 1)[0];
+    std::wstring name;
+    if (headline != 0) {
+        int32_t length = _memory->ReadData<int32_t>({headline + 0x10}, 1)[0];
+        if (length > 0 && length < 0x100) {
+            std::vector<wchar_t> chars = _memory->ReadData<wchar_t>({headline + 0x14}, length);
+            // Weirdly, some headlines have color labels, like <color=#FFFFFF>NAME</color>. Remove them.
+            bool inTag = false;
+            for (wchar_t ch : chars) {
+                if (ch == L'<') inTag = true;
+                else if (ch == L'>') inTag = false;
+                else if (!inTag) name.push_back(ch);
             }
-            deck.push_back(card);
-            i++;
         }
-        decks.push_back(deck);
-        i++;
+    }
+    return _roomNames.emplace(roomTemplate, std::move(name)).first->second;
+}
+
+void Trainer::UpdateDecks(const std::function<void(size_t slot, const DeckDecoder::Deck& deck)>& onChanged) {
+    std::lock_guard<std::mutex> l(_decksMutex);
+    if (!ReadBuffer()) return;
+
+    // The cached names never move, so the decoder can keep views of them.
+    bool changed = _deckDecoder.Decode(_bufferTemplates, [this](uint64_t roomTemplate) { return std::wstring_view(GetRoomName(roomTemplate)); });
+    _draftHistory.Flush();
+    if (!changed) return;
+    for (size_t slot = 0; slot < DeckDecoder::s_numSlots; slot++) {
+        const DeckDecoder::Deck& deck = _deckDecoder.GetDeck(slot);
+        if (deck.changed) onChanged(slot, deck);
+    }
+}
+
+void Trainer::SetRoomNames(const std::vector<std::wstring>& names) {
+    _roomNameList = names;
+    _roomNameOffsets.clear();
+    _roomNameTableSize = 0;
+    for (const auto& name : _roomNameList) {
+        _roomNameOffsets[name] = _roomNameTableSize;
+        _roomNameTableSize += (0x14 + (name.size() + 1) * sizeof(wchar_t) + 7) & ~7; // Keep each string 8-byte aligned
+    }
+}
+
+void Trainer::RecordDraft(size_t slot, const DeckDecoder::Deck& deck) {
+    // The override slots hold either a RoomTemplate, or a room name (tagged with the low bit) if the templates weren't resolved yet.
+    // The hook records the override it used, since the trainer may have changed it since.
+    std::wstring_view forced;
+    int64_t roomOverride = static_cast<int64_t>(deck.roomOverride);
+    if (roomOverride & 1) {
+        for (const auto& [name, offset] : _roomNameOffsets) {
+            if (_roomNameTable + offset == (roomOverride & ~1)) forced = name;
+        }
+    } else if (roomOverride != 0) {
+        forced = GetRoomName(roomOverride);
+    }
+
+    _draftStatsDeck.clear();
+    for (const auto& card : deck.cards) _draftStatsDeck.push_back(_draftStats.Intern(card.name));
+    _draftStats.AddDraft(static_cast<uint8_t>(slot), _draftStatsDeck.data(), _draftStatsDeck.size(), _draftStats.Intern(forced), _draftStats.Intern(deck.drawn.name));
+
+    if (!_draftHistory.IsOpen()) return;
+    _draftHistoryDeck.clear();
+    for (const auto& card : deck.cards) _draftHistoryDeck.push_back(_draftHistory.GetRoomId(card.name));
+    _draftHistory.Append(std::time(nullptr), static_cast<uint8_t>(slot), _draftHistory.GetRoomId(forced), _draftHistory.GetRoomId(deck.drawn.name), _draftHistoryDeck);
+}
+
+void Trainer::ReadDraftStats(const std::function<void(const DraftStats& stats)>& reader) {
+    std::lock_guard<std::mutex> l(_decksMutex);
+    reader(_draftStats);
+}
+
+void Trainer::WriteRoomNameTable() {
+    if (_roomNameTableSize == 0) return;
+
+    // Annoyingly, each name has to be a C# String, which has some extra nonsense: [vtable, monitor, int length, wchar_t chars[length + 1]]
+    // The vtable pointer is left null, as it always has been for our strings. The game only compares them, so C# doesn't seem to mind.
+    std::vector<byte> table(_roomNameTableSize, 0x00);
+    for (const auto& name : _roomNameList) {
+        __int64 offset = _roomNameOffsets[name];
+        int32_t length = static_cast<int32_t>(name.size());
+        std::copy_n(reinterpret_cast<const byte*>(&length), sizeof(length), &table[offset + 0x10]);
+        std::copy_n(reinterpret_cast<const byte*>(name.c_str()), name.size() * sizeof(wchar_t), &table[offset + 0x14]); // The null terminator is already zero
     }
 
-    return decks;
+    _roomNameTable = _memory->AllocateArray(table.size());
+    _memory->AddFeatureAllocation("PickRoomFromSlot", _roomNameTable);
+    // The table is a couple of pages long.
+    size_t written = _memory->WriteDataAcrossPages<byte>({_roomNameTable}, table);
+    assert(written == table.size(), "Failed to write the room name table");
+    _memory->SetJournalValue("PickRoomFromSlot", "RoomNameTable", _roomNameTable);
+    _memory->SetJournalValue("PickRoomFromSlot", "RoomNameTableSize", _roomNameTableSize);
 }
 
-void Trainer::ForceRoomDraft(const std::wstring& name, int slot) {
+void Trainer::ResolveRoomTemplates() {
+    __int64 database = 0;
+    {
+        std::lock_guard<std::mutex> l(_roomTemplatesMutex);
+        if (!_roomTemplates.empty() || _buffer == 0 || _roomNameTable == 0 || _getRoomByName == 0) return;
+        database = _memory->ReadData<__int64>({_buffer + 0x20}, 1)[0]; // Written by the draft hook, once the game has drafted a room
+        if (database == 0) return;
+    }
+
+    // Every name is looked up once (in a single batch), so the draft hook never has to search the database.
+    // The calls take a while, so they are made without the lock, and ForceRoomDraft keeps using the names in the meantime.
+    std::vector<Memory::FunctionCall> calls;
+    for (const auto& name : _roomNameList) calls.push_back({_getRoomByName, database, _roomNameTable + _roomNameOffsets[name]});
+    std::vector<std::future<__int64>> results = _memory->CallFunctions(calls);
+    std::unordered_map<std::wstring, __int64> roomTemplates;
+    for (size_t i = 0; i < _roomNameList.size(); i++) {
+        __int64 roomTemplate = results[i].get();
+        if (roomTemplate == 0) DebugPrint(L"Room is not in the game's database: " + _roomNameList[i]);
+        roomTemplates[_roomNameList[i]] = roomTemplate;
+    }
+
+    std::lock_guard<std::mutex> l(_roomTemplatesMutex);
+    // If the caches were invalidated in the meantime, these templates may belong to an old database.
+    if (!_roomTemplates.empty() || _memory->ReadData<__int64>({_buffer + 0x20}, 1)[0] != database) return;
+    _roomTemplates = std::move(roomTemplates);
+
+    // Replace any overrides which were set before the database was known.
+    std::vector<__int64> overrides = _memory->ReadData<__int64>({_buffer + 0x8}, 3);
+    for (int slot = 1; slot <= 3; slot++) {
+        __int64 roomName = overrides[slot - 1];
+        if ((roomName & 1) == 0) continue;
+        __int64 roomTemplate = 0;
+        for (const auto& [name, offset] : _roomNameOffsets) {
+            if (_roomNameTable + offset == (roomName & ~1)) roomTemplate = _roomTemplates[name];
+        }
+        _memory->WriteData<int64_t>({_buffer + 0x8 * slot}, {roomTemplate});
+    }
+}
+
+bool Trainer::ForceRoomDraft(const std::wstring& name, int slot) {
     assert(slot >= 1 && slot <= 3, "[INTERNAL ERROR] Attempted to set a slot which was too big");
     if (name.size() == 0) {
-        // Clear the override if we write an empty string
+        // Clear the override if we write an empty string. This takes the lock so that ResolveRoomTemplates can't bring it back.
+        std::lock_guard<std::mutex> l(_roomTemplatesMutex);
         _memory->WriteData<int64_t>({_buffer + 0x8 * slot}, {0});
-        return;
-    }
-    // Annoyingly, we have to allocate a C# String here, which has some extra nonsense.
-    // TODO: I am not actually allocating the vtable pointer. It seems like C# doesn't mind.
-    std::vector<byte> stringBytes = {
-        LONG_TO_BYTES(0), // vtable
-        LONG_TO_BYTES(0), // unused
-        INT_TO_BYTES(name.size()), // size of string
-    };
-    for (wchar_t ch : name) {
-        stringBytes.push_back((ch & 0x00FF) >> 0x00);
-        stringBytes.push_back((ch & 0xFF00) >> 0x08);
+        return true;
     }
 
-    // Append a null terminator
-    stringBytes.push_back(0x00);
-    stringBytes.push_back(0x00);
+    auto search = _roomNameOffsets.find(name);
+    if (search == _roomNameOffsets.end() || _roomNameTable == 0) {
+        DebugPrint(L"Cannot force an unknown room: " + name);
+        return false;
+    }
 
-    __int64 addr = _memory->AllocateArray(stringBytes.size());
-    _memory->WriteData<byte>({addr}, stringBytes);
-    _memory->WriteData<int64_t>({_buffer + 0x8 * slot}, {addr});
+    std::lock_guard<std::mutex> l(_roomTemplatesMutex);
+    if (_roomTemplates.empty()) {
+        // We can't look up templates until we know where the database is, so have the draft hook look up the name instead (tagged with the low bit).
+        _memory->WriteData<int64_t>({_buffer + 0x8 * slot}, {_roomNameTable + search->second + 1});
+        return true;
+    }
+    __int64 roomTemplate = _roomTemplates[name];
+    if (roomTemplate == 0) return false; // Already reported by ResolveRoomTemplates
+    _memory->WriteData<int64_t>({_buffer + 0x8 * slot}, {roomTemplate});
+    return true;
 }
 
-void Trainer::HookFsmInt() {
-    int64_t setIntValue = 0;
-    _memory->AddSigScan("48 8B 71 50 48 85 FF 74 62", [&](int64_t offset, int index, const std::vector<uint8_t>& data) {
-        setIntValue = offset + index + 4;
-    });
+void Trainer::DeclareFsmIntScans() {
+    constexpr Signature setIntValue = SIG("48 8B 71 50 48 85 FF 74 62");
+    _setIntValueScan = _memory->AddSigScan(setIntValue, Memory::SigScanScope::Process);
+}
 
-    size_t numFailedScans = _memory->ExecuteSigScans();
-    assert(numFailedScans == 0, "Failed to find scan for FsmInt");
+bool Trainer::ResolveFsmInt() {
+    _setIntValue = _setIntValueScan.Found() ? _setIntValueScan.Address() + 4 : 0;
+    assert(_setIntValue != 0, "Failed to find scan for FsmInt");
+    return _setIntValue != 0;
+}
 
-    _memory->WriteData<byte>({setIntValue + 34}, {0x19});
-    _memory->Intercept("SetIntValue", setIntValue, setIntValue + 20, {
+void Trainer::HookFsmInt(Memory::PatchTransaction& patch) {
+    const __int64 setIntValue = _setIntValue;
+    patch.Write("SetIntValue", setIntValue + 34, {0x19});
+    _memory->Intercept(patch, "SetIntValue", setIntValue, setIntValue + 20, {
         0x4C, 0x8B, 0x46, 0x18,                             // mov r8,qword ptr ds:[rsi+18]     ; r8 = FsmInt.Name (the FSM variable is saved on rsi)
         0x49, 0x83, 0xC0, 0x14,                             // add r8,4                         ; r8 = &Name.data
         IF_EQ(0x41, 0x81, 0x38, INT_TO_BYTES(0x540053)),    // cmp dword ptr ds:[r8],0x540053   ; cmp [r8], L"ST"
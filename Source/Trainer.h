@@ -1,12 +1,16 @@
 #pragma once
 #include "ProcStatus.h"
+#include "RngLog.h"
+#include "DeckDecoder.h"
+#include "DraftHistory.h"
+#include "DraftStats.h"
 
 class Trainer final : public std::enable_shared_from_this<Trainer> {
 public:
     Trainer(std::shared_ptr<Memory> memory);
     void StartHeartbeat(HWND window, UINT message);
     bool HeartbeatActive() const { return _threadActive; }
-    void StopHeartbeat() { _threadActive = false; }
+    void StopHeartbeat();
     ~Trainer();
 
     enum RngClass : byte {
@@ -41,15 +45,39 @@ public:
     RngBehavior GetRngBehavior(RngClass rngClass)  { return _memory->ReadData<RngBehavior>({_rngBehaviors + rngClass}, 1)[0]; }
     std::vector<RngBehavior> GetAllBehaviors() { return _memory->ReadData<RngBehavior>({_rngBehaviors}, RngClass::NumEntries); }
 
-    std::vector<std::vector<std::wstring>> GetDecks();
-    void ForceRoomDraft(const std::wstring& name, int slot);
+    // Identifies the RNG kernels running in the game, so that seeds can be reproduced. 0 if the game has not been derandomized.
+    static constexpr uint64_t s_rngAlgorithm = 3; // 1: FNV-1a hash + div, 2: splitmix64 + Lemire reduction, 3: direct 23-bit float kernel
+    uint64_t GetRngAlgorithm() { return _memory->GetJournalValue("Derandomize", "RngAlgorithm"); }
+
+    // Every injected RNG draw is counted, both per RngClass and per call site (in sigscan order).
+    struct RngCounters {
+        std::vector<uint64_t> classDraws;
+        std::vector<uint64_t> callSiteDraws;
+        std::vector<double> classDrawsPerSecond; // Since the previous poll
+    };
+    RngCounters PollRngCounters();
+
+    // Record mode appends every injected RNG draw to a ring in the game, which the heartbeat drains into an RngLog called name
+    // (next to the trainer). Returns false if the game is not derandomized yet, or the log could not be created.
+    bool StartRngRecording(const std::wstring& name);
+    void StopRngRecording();
+
+    // Decodes any decks drafted since the last call, and calls onChanged for each draft slot whose deck changed.
+    void UpdateDecks(const std::function<void(size_t slot, const DeckDecoder::Deck& deck)>& onChanged);
+    // Statistics over every draft seen by this trainer (which are also recorded in the draft history). Only valid during the callback.
+    void ReadDraftStats(const std::function<void(const DraftStats& stats)>& reader);
+    // The rooms which ForceRoomDraft accepts. Must be set before the heartbeat starts; the names are written into the game once, when we attach.
+    void SetRoomNames(const std::vector<std::wstring>& names);
+    // Returns false if the room is not known, either to the trainer or to the game.
+    bool ForceRoomDraft(const std::wstring& name, int slot);
 
 private:
     ProcStatus Heartbeat();
-    void OnGameStart();
+    void OnGameStart(const std::shared_ptr<const CancellationToken>& token);
 
     std::shared_ptr<Memory> _memory;
     bool _threadActive = false;
+    HANDLE _heartbeatStopEvent = nullptr; // Wakes the heartbeat thread, so that it stops promptly
     std::thread _thread;
     bool _firstHeartbeat = true;
     bool _gameWasStarted = false;
@@ -59,30 +87,126 @@ private:
 #else // Induce more stress in debug, to catch errors more easily.
     static constexpr std::chrono::milliseconds s_heartbeat = std::chrono::milliseconds(10);
 #endif
+    static constexpr std::chrono::milliseconds s_idleHeartbeat = std::chrono::milliseconds(1000); // Longest wait between attempts to find the game
+    static constexpr std::chrono::milliseconds s_startupDelay = std::chrono::milliseconds(0x1000); // Apparently the loading status is 0 even though the game isn't quite ready
+    static constexpr wchar_t s_journalFile[] = L"BluePrinceRandomizer.journal"; // Lets a restarted trainer take over the edits of one which died
 
+    // The attach steps of each feature (see OnGameStart). Scan and resolve results are kept in members, for the later stages.
+    // The Restore steps replace the allocate and assemble steps for features which were restored from the journal.
     void InjectCustomRng();
-    bool FindAllRngFunctions();
-    void OverwriteRngFunctions();
-    void InjectDraftWatcher();
-    void HookFsmInt();
-    std::vector<wchar_t> ReadBuffer();
+    bool RestoreCustomRng();
+    void MapRngCallSites();
+    void DeclareRngScans();
+    bool ResolveRngFunctions();
+    void OverwriteRngFunctions(Memory::PatchTransaction& patch);
+    void DeclareDraftWatcherScans();
+    bool ResolveDraftWatcher();
+    void AllocateDraftBuffer();
+    bool RestoreDraftWatcher();
+    void InjectDraftWatcher(Memory::PatchTransaction& patch);
+    void DeclareFsmIntScans();
+    bool ResolveFsmInt();
+    void HookFsmInt(Memory::PatchTransaction& patch);
+    __int64 _pickRoomFromSlot = 0;
+    __int64 _pickTop = 0;
+    __int64 _createCard = 0;
+    __int64 _setIntValue = 0;
+    Memory::SigScanHandle _pickRoomFromSlotScan;
+    Memory::SigScanHandle _getRoomByNameScan;
+    Memory::SigScanHandle _setIntValueScan;
+    bool ReadBuffer(); // Reads any new templates into _bufferTemplates. Must hold _decksMutex
+    const std::wstring& GetRoomName(uint64_t roomTemplate); // Must hold _decksMutex
 
     struct SigScanTemplate {
         RngClass rngClass = RngClass::Unknown;
-        std::string scanHex;
+        Signature signature;
         int offsetFromScan = 0;
         __int64 foundAddress = 0; // Relative to the baseAddress
         __int64 targetFunction = 0; // Relative to the baseAddress
+        byte callOpcode = 0; // The opcode of the instruction which ends at foundAddress + 4
+        __int64 callSiteStub = 0; // Counts calls from this site, then jumps to the shim for rngClass. 0 if the stub is out of rel32 range.
     };
 
     std::vector<SigScanTemplate> _sigScans1;
     std::vector<SigScanTemplate> _sigScans2;
     std::vector<SigScanTemplate> _sigScans3;
+    std::vector<Memory::SigScanHandle> _rngScans; // One for each entry in the tables above
+    void RedirectRngCallSite(Memory::PatchTransaction& patch, const SigScanTemplate& sigScan);
+    void FindIcallRngSlots();
+    void ClassifyIcallRngCallers();
+    void RedirectIcallRngSlots(Memory::PatchTransaction& patch);
+    struct IcallCaller {
+        __int64 start; // Bounds of the calling function
+        __int64 end;
+        RngClass rngClass;
+    };
+    struct IcallSlot {
+        size_t icall; // Index into s_rngIcalls
+        __int64 slot;
+        std::vector<IcallCaller> callers;
+    };
+    std::vector<IcallSlot> _icallSlots;
+    Memory::SigScanHandle _icallNameScans[3]; // Finds every copy of each name in s_rngIcalls
+    static constexpr __int64 s_icallStoreDistance = 0x40; // How far past the icall lookup to look for the store into its cache slot
+    static constexpr __int64 s_maxFunctionSize = 0x2000; // How far from an icall lookup to look for the bounds of its calling function
 
-    __int64 _rngSeedArray = 0;
+    __int64 _rngSeedArray = 0; // [seeds, class counters, call site counters, record flag, call site stubs]
+    __int64 GetRngClassCounters() const { return _rngSeedArray + s_classCountersOffset; }
+    __int64 GetRngCallSiteCounters() const { return GetRngClassCounters() + RngClass::NumEntries * sizeof(uint64_t); }
+    static constexpr byte s_classCountersOffset = RngClass::NumEntries * sizeof(__int64);
+    static_assert(s_classCountersOffset < 0x80, "The class counters are addressed with a disp8 in the RNG kernels");
+    static constexpr __int64 s_callSiteStubSize = 16;
+    __int64 _numRngCallSites = 0;
+    std::mutex _rngCountersMutex; // Guards the previous poll, since the UI may poll from any of its workers
+    std::vector<uint64_t> _lastRngClassDraws;
+    std::chrono::steady_clock::time_point _lastRngPoll;
     __int64 _rngBehaviors = 0;
     __int64 _intRngFunction = 0;
     __int64 _floatRngFunction = 0;
+    static constexpr __int64 s_floatRangeEntry = 14; // Offset of the Random.Range entry point in _floatRngFunction (Random.value starts at 0)
+
+    struct RngRecordEntry {
+        uint64_t returnAddress;
+        uint32_t min; // For float draws, these are the bits of the floats
+        uint32_t max;
+        uint32_t value;
+        RngClass rngClass;
+        byte padding[3];
+        uint64_t sequence; // Index + 1, written last. Until it matches, the entry is still being written.
+    };
+    void DrainRngRecording(); // Must hold _rngRecordMutex
+    __int64 GetRngRecordFlag() const { return GetRngCallSiteCounters() + _numRngCallSites * sizeof(uint64_t); }
+    static constexpr byte s_rngRecordHeaderSize = 0x40; // [writeCount, padding to a cache line]
+    static constexpr uint64_t s_rngRecordCapacity = 0x10000; // Must be a power of 2
+    __int64 _rngRecordRing = 0;
+    std::mutex _rngRecordMutex;
+    uint64_t _rngRecordReadCount = 0;
+    RngLogWriter _rngLog;
+    std::unordered_map<uint64_t, uint16_t> _rngCallSiteByReturnAddress;
     __int64 _buffer = 0;
-    int64_t _bufferPosition = 32; // [bufferSize, roomOverride1, roomOverride2, roomOverride3]
+    int64_t _bufferPosition = s_bufferHeaderSize;
+    bool _bufferFull = false; // Reported once, when the hook first drops a draft
+    void WriteRoomNameTable();
+    void ResolveRoomTemplates();
+    std::vector<std::wstring> _roomNameList;
+    std::unordered_map<std::wstring, __int64> _roomNameOffsets; // Offset of each name's C# String in the table
+    __int64 _roomNameTableSize = 0;
+    __int64 _roomNameTable = 0;
+    __int64 _getRoomByName = 0;
+    std::mutex _roomTemplatesMutex;
+    std::unordered_map<std::wstring, __int64> _roomTemplates; // Name => RoomTemplate, or 0 if the game doesn't know the name. Empty until the database is known.
+    static constexpr int64_t s_bufferSize = 0x1'000'000;
+    static constexpr int64_t s_bufferHeaderSize = 0x30; // [bufferSize, roomOverride1, roomOverride2, roomOverride3, roomDatabase, droppedDrafts]
+    static constexpr uint64_t s_bufferLayout = 3; // Bumped whenever the hook changes what it writes, so that a restored hook is only used by a trainer which can read it
+    std::mutex _decksMutex;
+    std::vector<uint64_t> _bufferTemplates;
+    DeckDecoder _deckDecoder;
+    // Every decoded deck is recorded into a draft history store, one per game session. See DraftHistory.h
+    static constexpr wchar_t s_draftHistoryDirectory[] = L"DraftHistory"; // Next to the trainer
+    void RecordDraft(size_t slot, const DeckDecoder::Deck& deck); // Must hold _decksMutex
+    DraftHistoryWriter _draftHistory;
+    std::vector<uint16_t> _draftHistoryDeck;
+    DraftStats _draftStats;
+    std::vector<uint16_t> _draftStatsDeck;
+    std::unordered_map<uint64_t, std::wstring> _roomNames; // RoomTemplate address => name. Templates are never freed (or moved) while the game runs.
 };
@@ -43,6 +43,10 @@
 #include <iomanip>
 #include <sstream>
 #include <thread>
+#include <future>
+#include <optional>
+#include <condition_variable>
+#include <unordered_map>
 
 #pragma warning (disable: 26451) // Potential arithmetic overflow
 #pragma warning (disable: 26812) // Unscoped enum type
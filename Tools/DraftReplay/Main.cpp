@@ -0,0 +1,87 @@
+// Offline draft statistics, replayed from the DraftHistory stores which the trainer writes (see Source/DraftHistory.h and Source/DraftStats.h).
+// Builds on Windows against the Source library, from a Developer Command Prompt:
+//   cl /std:c++17 /EHsc /O2 /I..\..\Source Main.cpp ..\..\x64\Release\Source.lib user32.lib dbghelp.lib /Fe:draftreplay.exe
+//
+// Usage: draftreplay [--threads <n>] [--pairs] <store or DraftHistory directory> ...
+//   A directory without a rooms.dict is taken to hold stores (like the trainer's DraftHistory directory), and every store in it is replayed.
+//   Prints one CSV row per room: its share of all draws, how often it was drawn and forced, the fraction of each slot's decks which offered it,
+//   and its longest streak of consecutive rounds. --pairs prints how often each pair of rooms was drawn in the same round instead.
+#include "pch.h"
+#include "DraftStats.h"
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+static const wchar_t* s_usage = L"Usage: draftreplay [--threads <n>] [--pairs] <store or DraftHistory directory> ...\n";
+
+static void AddStores(const std::filesystem::path& path, std::vector<std::wstring>& stores) {
+    if (std::filesystem::exists(path / L"rooms.dict")) {
+        stores.push_back(path.wstring());
+        return;
+    }
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(path, error)) {
+        if (entry.is_directory() && std::filesystem::exists(entry.path() / L"rooms.dict")) stores.push_back(entry.path().wstring());
+    }
+}
+
+int wmain(int argc, wchar_t** argv) {
+    unsigned threads = 0;
+    bool pairs = false;
+    std::vector<std::wstring> stores;
+    for (int i = 1; i < argc; i++) {
+        std::wstring arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == L"--threads" && hasValue) threads = std::stoul(argv[++i]);
+        else if (arg == L"--pairs") pairs = true;
+        else if (arg.rfind(L"--", 0) == 0) {
+            fwprintf(stderr, L"Unknown argument: %ls\n%ls", arg.c_str(), s_usage);
+            return 1;
+        } else if (!std::filesystem::is_directory(arg)) {
+            fwprintf(stderr, L"Not a directory: %ls\n%ls", arg.c_str(), s_usage);
+            return 1;
+        } else {
+            AddStores(arg, stores);
+        }
+    }
+    if (stores.empty()) {
+        fwprintf(stderr, L"No draft history stores found\n%ls", s_usage);
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    DraftStats stats = DraftStats::Replay(stores, threads);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const DraftStats::Counts& counts = stats.GetCounts();
+    uint32_t numDecks = 0;
+    for (uint32_t decks : counts.decks) numDecks += decks;
+    fwprintf(stderr, L"Replayed %u drafts from %zu stores in %.2fs\n", numDecks, stores.size(), seconds);
+
+    const size_t numRoomIds = std::min(stats.NumRoomIds(), DraftStats::s_maxRooms);
+    if (pairs) {
+        wprintf(L"roomA,roomB,drawnTogether\n");
+        for (uint16_t a = 1; a < numRoomIds; a++) {
+            for (uint16_t b = a; b < numRoomIds; b++) {
+                if (counts.drawnTogether[a][b] == 0) continue;
+                wprintf(L"\"%ls\",\"%ls\",%u\n", std::wstring(stats.RoomName(a)).c_str(), std::wstring(stats.RoomName(b)).c_str(), counts.drawnTogether[a][b]);
+            }
+        }
+        return 0;
+    }
+
+    wprintf(L"room,drawRate,drawn,forced,offered1,offered2,offered3,longestStreak\n");
+    static_assert(DraftStats::s_numSlots == 3, "The header only lists three slots");
+    for (uint16_t roomId = 1; roomId < numRoomIds; roomId++) {
+        uint32_t drawn = 0;
+        uint32_t forced = 0;
+        for (size_t slot = 0; slot < DraftStats::s_numSlots; slot++) {
+            drawn += counts.drawn[slot][roomId];
+            forced += counts.forced[slot][roomId];
+        }
+        wprintf(L"\"%ls\",%.5f,%u,%u,%.5f,%.5f,%.5f,%u\n", std::wstring(stats.RoomName(roomId)).c_str(), stats.DrawRate(roomId), drawn, forced,
+            stats.OfferedRate(0, roomId), stats.OfferedRate(1, roomId), stats.OfferedRate(2, roomId), counts.longestStreak[roomId]);
+    }
+    return 0;
+}
@@ -0,0 +1,110 @@
+// Headless seed search for the injected RNG (see Source/SeedSearch.h). Builds on Linux with:
+//   g++ -std=c++17 -O3 -march=native -ffp-contract=off -pthread -I../../Source Main.cpp ../../Source/SeedSearch.cpp -o seedsearch
+//
+// Usage: seedsearch [--first <seed>] [--count <n>] [--results <n>] [--threads <n>] [--ranked] --draw <min>,<max>[:<value>[|<value>...]] ...
+//   Each --draw is one Random.Range(min, max) call in the searched RngClass, in order. Without a ':', the draw may return anything.
+//   By default only seeds matching every draw are returned; --ranked also returns partial matches, best first.
+// Example: the first 3 Drafting draws from decks of 40, 39 and 38 cards pick indices 0, (0 or 1), and 5:
+//   seedsearch --count 100000000 --draw 0,40:0 --draw 0,39:0|1 --draw 0,38:5
+#include "SeedSearch.h"
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+static const char* s_usage = "Usage: seedsearch [--first <seed>] [--count <n>] [--results <n>] [--threads <n>] [--ranked] --draw <min>,<max>[:<value>[|<value>...]] ...\n";
+
+// Each number must be the whole of its text. (strtoll and strtoull skip leading spaces, and strtoull accepts a '-', so those are checked first.)
+static bool ParseInt(const std::string& text, int32_t& value) {
+    if (text.empty() || !(std::isdigit(static_cast<unsigned char>(text[0])) || text[0] == '-')) return false;
+    char* end = nullptr;
+    errno = 0;
+    long long parsed = std::strtoll(text.c_str(), &end, 10);
+    if (*end != '\0' || errno == ERANGE || parsed < INT32_MIN || parsed > INT32_MAX) return false;
+    value = static_cast<int32_t>(parsed);
+    return true;
+}
+
+static bool ParseCount(const std::string& text, uint64_t maxValue, uint64_t& value) {
+    if (text.empty() || !std::isdigit(static_cast<unsigned char>(text[0]))) return false;
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long parsed = std::strtoull(text.c_str(), &end, 10);
+    if (*end != '\0' || errno == ERANGE || parsed > maxValue) return false;
+    value = parsed;
+    return true;
+}
+
+static bool ParseDraw(const std::string& text, SeedSearch::DrawConstraint& draw) {
+    size_t comma = text.find(',');
+    if (comma == std::string::npos) return false;
+    size_t colon = text.find(':', comma);
+    if (!ParseInt(text.substr(0, comma), draw.minInclusive)) return false;
+    if (!ParseInt(text.substr(comma + 1, colon - comma - 1), draw.maxExclusive)) return false;
+    if (colon == std::string::npos) return true;
+
+    for (size_t start = colon + 1; start <= text.size();) {
+        size_t end = text.find('|', start);
+        if (end == std::string::npos) end = text.size();
+        int32_t value = 0;
+        if (!ParseInt(text.substr(start, end - start), value)) return false;
+        draw.allowed.push_back(value);
+        start = end + 1;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    SeedSearch::Query query;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        uint64_t value = 0;
+        if ((arg == "--first" || arg == "--count" || arg == "--results" || arg == "--threads") && hasValue) {
+            const uint64_t maxValue = (arg == "--threads") ? UINT_MAX : (arg == "--results") ? SIZE_MAX : UINT64_MAX;
+            if (!ParseCount(argv[++i], maxValue, value)) {
+                fprintf(stderr, "Malformed %s: %s\n%s", arg.c_str(), argv[i], s_usage);
+                return 1;
+            }
+            if (arg == "--first") query.firstSeed = value;
+            else if (arg == "--count") query.seedCount = value;
+            else if (arg == "--results") query.maxResults = static_cast<size_t>(value);
+            else query.threads = static_cast<unsigned>(value);
+        }
+        else if (arg == "--ranked") query.requireAll = false;
+        else if (arg == "--draw" && hasValue) {
+            SeedSearch::DrawConstraint draw;
+            if (!ParseDraw(argv[++i], draw)) {
+                fprintf(stderr, "Malformed draw: %s\n%s", argv[i], s_usage);
+                return 1;
+            }
+            if (draw.maxExclusive < draw.minInclusive) {
+                // The range would otherwise wrap around to (nearly) 2^32 values, each with its own entry in the allowed table.
+                fprintf(stderr, "Draw %s has max < min\n%s", argv[i], s_usage);
+                return 1;
+            }
+            query.draws.push_back(draw);
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n%s", arg.c_str(), s_usage);
+            return 1;
+        }
+    }
+    if (query.draws.empty()) {
+        fprintf(stderr, "At least one --draw is required\n%s", s_usage);
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<SeedSearch::Result> results = SeedSearch::Run(query);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    fprintf(stderr, "Searched %llu seeds in %.2fs (%.1fM seeds/s), RNG algorithm %llu\n",
+        (unsigned long long)query.seedCount, seconds, query.seedCount / seconds / 1e6, (unsigned long long)RngEmulator::s_rngAlgorithm);
+    for (const auto& result : results) {
+        printf("%llu %u/%zu %u\n", (unsigned long long)result.seed, result.satisfied, query.draws.size(), result.prefix);
+    }
+    return 0;
+}